@@ -0,0 +1,235 @@
+// Microbenchmarks of the building blocks of an image: the functions of the pool, the evaluation of random functions,
+// the color maps and the whole generate(). The results are written as csv or json, so runs of different commits can
+// be compared.
+
+#include <CLI11.hpp>
+
+#include "GenerativeArt.h"
+#include "Harness.h"
+
+#include <omp.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// accepted images with the default options, see Settings::read_file_name()
+const std::vector<std::string> sample_images = {
+    "3235022989.1125252055.13.4.4.7.100.190.2.3.-9600.9600.0.0.100.0.100",
+    "609019643.2580785354.13.4.4.7.100.190.2.3.-9600.9600.0.0.100.0.100"
+};
+
+/**
+ * Arguments evenly spread over [-4, 4], the range most nodes of a random function see.
+ */
+std::vector<argument_type> arguments(const size_t n, const size_t offset = 0)
+{
+    std::vector<argument_type> args(n);
+    for(size_t i = 0; i < n; i++)
+        args[i] = -4.f + 8.f * static_cast<argument_type>((i * 7 + offset) % n) / static_cast<argument_type>(n);
+    return args;
+}
+
+void bench_function_pool(Harness& harness)
+{
+    constexpr size_t n = 4096;
+    const std::vector<argument_type> a = arguments(n);
+    const std::vector<argument_type> b = arguments(n, n / 3);
+
+    for(size_t f = 0; f < FunctionPool::unary.size(); f++)
+    {
+        const auto& desc = FunctionPool::unary_string[f];
+        harness.run("unary", std::to_string(f) + " " + desc.first + "x" + desc.second, n, 1, [&]()
+        {
+            const auto& function = FunctionPool::unary[f];
+            argument_type sum = 0;
+            for(size_t i = 0; i < n; i++)
+                sum += function(a[i]);
+            keep(sum);
+        });
+    }
+
+    for(size_t f = 0; f < FunctionPool::binary.size(); f++)
+    {
+        const auto& desc = FunctionPool::binary_string[f];
+        harness.run("binary", std::to_string(f) + " " + std::get<0>(desc) + "x" + std::get<1>(desc) + "y"
+                              + std::get<2>(desc), n, 1, [&]()
+        {
+            const auto& function = FunctionPool::binary[f];
+            argument_type sum = 0;
+            for(size_t i = 0; i < n; i++)
+                sum += function(a[i], b[i]);
+            keep(sum);
+        });
+    }
+}
+
+/**
+ * Evaluates the function on a dim x dim grid of the unit square by one thread.
+ */
+void evaluate(const RandomFunction& rf, const uint32_t dim, argument_type* values)
+{
+    const auto step_size = 1.f / static_cast<argument_type>(dim);
+    for(uint32_t j = 0; j < dim; j++)
+        for(uint32_t i = 0; i < dim; i++)
+            values[j * dim + i] = rf.eval(static_cast<argument_type>(i) * step_size,
+                                          static_cast<argument_type>(j) * step_size);
+}
+
+std::unique_ptr<RandomFunction> draw_function(const unsigned int seed, const unsigned int depth)
+{
+    const GenerativeArt::Settings settings;
+    std::default_random_engine prng(seed);
+    return std::unique_ptr<RandomFunction>(new RandomFunction(prng, depth, settings.function_param,
+                                                              settings.unary_function_pool_size,
+                                                              settings.binary_function_pool_size));
+}
+
+void bench_trees(Harness& harness, const std::vector<unsigned int>& depths, const std::vector<unsigned int>& seeds)
+{
+    constexpr uint32_t dim = 64;
+    std::vector<argument_type> values(dim * dim);
+
+    for(const unsigned int depth : depths)
+        for(const unsigned int seed : seeds)
+        {
+            const auto rf = draw_function(seed, depth);
+            harness.run("tree", "depth " + std::to_string(depth) + " seed " + std::to_string(seed), dim * dim, 1,
+                        [&]()
+            {
+                evaluate(*rf, dim, values.data());
+                keep(values[0]);
+            });
+        }
+}
+
+void bench_color_maps(Harness& harness, const std::vector<unsigned int>& seeds)
+{
+    constexpr uint32_t dim = 256;
+    std::vector<argument_type> values(dim * dim);
+    evaluate(*draw_function(1, 7), dim, values.data());
+
+    std::vector<uint8_t> colors(values.size() * 3);
+    const GenerativeArt::Settings settings;
+
+    const std::vector<std::pair<std::string, ColorMap::projection_type>> projections = {
+        {"cap", ColorMap::cap}, {"periodic", ColorMap::periodic}, {"smooth_periodic", ColorMap::smooth_periodic}
+    };
+
+    for(const auto& projection : projections)
+        for(const unsigned int seed : seeds)
+        {
+            std::default_random_engine prng(seed);
+            const PolynomialColorMap cm(prng, projection.second, settings.color_poly_deg, settings.color_poly_param);
+            harness.run("color_map", projection.first + " seed " + std::to_string(seed), values.size(), 1, [&]()
+            {
+                for(size_t i = 0; i < values.size(); i++)
+                    cm.get_color(values[i], colors[3 * i], colors[3 * i + 1], colors[3 * i + 2]);
+                keep(colors[0]);
+            });
+        }
+}
+
+void bench_generate(Harness& harness, const std::vector<unsigned int>& resolutions, const std::string& directory,
+                    const std::string& format)
+{
+    for(const unsigned int resolution : resolutions)
+        for(const auto& image : sample_images)
+        {
+            const std::string name = image.substr(0, image.find(delimiter)) + " r " + std::to_string(resolution);
+            if(!harness.selected("generate", name))
+                continue;
+
+            GenerativeArt::Settings settings;
+            settings.read_file_name(image, true, true, true);
+            settings.resolution = resolution;
+            settings.scale_resolution();
+            settings.num_samples = 1;
+            settings.directory = directory;
+            settings.format = format == "ppm" ? ImageWriter::ppm
+                              : (format == "pam" ? ImageWriter::pam
+                                 : (format == "qoi" ? ImageWriter::qoi : ImageWriter::png));
+
+            GenerativeArt ga(settings);
+            if(!ga.generate())
+                std::cerr << "warning: " << image << " was rejected, only the rejection is timed" << std::endl;
+
+            const uint64_t num_pixels =
+                static_cast<uint64_t>(static_cast<uint32_t>((settings.x.max - settings.x.min) * settings.resolution))
+                * static_cast<uint32_t>((settings.y.max - settings.y.min) * settings.resolution);
+            harness.run("generate", name, num_pixels, omp_get_max_threads(), [&]()
+            {
+                ga.generate();
+            });
+        }
+}
+
+int main(int argc, char** argv)
+{
+    CLI::App app("Microbenchmarks of the function pool, the random functions, the color maps and generate().");
+
+    Harness::Options options;
+    app.add_option("-r,--repetitions", options.repetitions, "Minimal number of samples of every case.", true)
+        ->check(CLI::Range(1u, 100000u));
+    app.add_option("--min-time", options.min_time, "Minimal seconds spent on the samples of every case.", true);
+    app.add_option("--filter", options.filter, "Runs only the cases whose group/name contains this text.");
+    app.add_flag("--counters", options.counters,
+                 "Adds the hardware event counts per item, e.g. cycles and cache misses. Counters the system does not "
+                 "provide stay empty.");
+
+    std::vector<unsigned int> depths = {2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12};
+    app.add_option("--depths", depths, "Depths of the evaluated random functions.", true);
+    std::vector<unsigned int> seeds = {1, 2, 3};
+    app.add_option("--seeds", seeds, "Seeds of the random functions and color maps.", true);
+    std::vector<unsigned int> resolutions = {200, 500, 1000};
+    app.add_option("--resolutions", resolutions, "Resolutions of the generate() cases.", true);
+    std::string directory = "/tmp/";
+    app.add_option("--directory", directory, "Where generate() stores its images.", true);
+    std::string image_format = "png";
+    app.add_set("--image-format", image_format, {"png", "ppm", "pam", "qoi"},
+                "The file format generate() writes.", true);
+
+    std::string format = "csv";
+    app.add_set("--format", format, {"csv", "json"}, "The format of the results.", true);
+    std::string output;
+    app.add_option("-o,--output", output, "File for the results. Empty writes them to stdout.");
+
+    try
+    {
+        app.parse(argc, argv);
+    }
+    catch(const CLI::ParseError& e)
+    {
+        return app.exit(e);
+    }
+
+    Harness harness(options);
+    bench_function_pool(harness);
+    bench_trees(harness, depths, seeds);
+    bench_color_maps(harness, seeds);
+    bench_generate(harness, resolutions, directory, image_format);
+
+    std::ofstream file;
+    if(!output.empty())
+    {
+        file.open(output);
+        if(!file)
+        {
+            std::cerr << "Could not open " << output << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& out = output.empty() ? std::cout : file;
+
+    if(format == "csv")
+        harness.write_csv(out);
+    else
+        harness.write_json(out, {{"compiler", __VERSION__},
+                                 {"threads", std::to_string(omp_get_max_threads())},
+                                 {"missing_counters", options.counters ? PerfCounters::missing_reason() : ""}});
+
+    return 0;
+}
@@ -0,0 +1,152 @@
+// Compares image buffers that are zeroed by the main thread with buffers that are first touched by the threads that
+// compute into them. On machines with several NUMA nodes the zeroed buffers end up on the node of the main thread and
+// the other sockets work on remote memory.
+
+#include <CLI11.hpp>
+
+#include "Buffer.h"
+#include "ThreadAffinity.h"
+
+#include <omp.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * The share of the pages of a buffer on every NUMA node. Only every 64th page is looked at.
+ */
+std::map<int, double> page_nodes(const void* data, const size_t bytes)
+{
+    const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const uintptr_t first = reinterpret_cast<uintptr_t>(data) / page_size * page_size;
+
+    std::vector<void*> pages;
+    for(uintptr_t page = first; page < reinterpret_cast<uintptr_t>(data) + bytes; page += 64 * page_size)
+        pages.push_back(reinterpret_cast<void*>(page));
+
+    std::vector<int> status(pages.size(), -1);
+    std::map<int, double> nodes;
+#ifdef SYS_move_pages
+    // without target nodes move_pages only reports the node of every page
+    if(syscall(SYS_move_pages, 0, pages.size(), pages.data(), nullptr, status.data(), 0) != 0)
+        return nodes;
+
+    for(const int node : status)
+        if(node >= 0)
+            nodes[node] += 1.0 / pages.size();
+#endif
+    return nodes;
+}
+
+/**
+ * The same access pattern as coloring an image: read one value and write three colors per pixel.
+ */
+template<typename Values, typename Colors>
+double color_pass(const Values& values, Colors& colors)
+{
+    const double start = omp_get_wtime();
+
+#pragma omp parallel for schedule(static)
+    for(uint64_t i = 0; i < values.size(); i++)
+    {
+        const float v = values[i];
+        colors[3 * i] = static_cast<uint8_t>(v * 255.f);
+        colors[3 * i + 1] = static_cast<uint8_t>(v * 127.f);
+        colors[3 * i + 2] = static_cast<uint8_t>(v * 63.f);
+    }
+
+    return omp_get_wtime() - start;
+}
+
+template<typename Values, typename Colors>
+void run(const std::string& name, Values& values, Colors& colors, const double setup_seconds,
+         const unsigned int repetitions)
+{
+    std::vector<double> seconds;
+    for(unsigned int r = 0; r < repetitions; r++)
+        seconds.push_back(color_pass(values, colors));
+    std::sort(seconds.begin(), seconds.end());
+
+    const double bytes = static_cast<double>(values.size()) * (sizeof(float) + 3);
+    const double median = seconds[seconds.size() / 2];
+
+    std::cout << std::left << std::setw(14) << name
+              << std::right << std::fixed << std::setprecision(1)
+              << std::setw(12) << setup_seconds * 1000.0
+              << std::setw(12) << median * 1000.0
+              << std::setw(12) << bytes / median / 1e9 << "   ";
+
+    const auto nodes = page_nodes(values.data(), values.size() * sizeof(float));
+    if(nodes.empty())
+        std::cout << "unknown";
+    for(const auto& node : nodes)
+        std::cout << node.first << ":" << std::setprecision(0) << node.second * 100.0 << "% ";
+    std::cout << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    CLI::App app("Bandwidth of the coloring pass with zeroed and with first touched image buffers.");
+
+    unsigned int megapixels = 256;
+    app.add_option("-m,--megapixels", megapixels, "The size of the image.", true);
+    unsigned int repetitions = 10;
+    app.add_option("-r,--repetitions", repetitions, "Number of timed passes, the median is shown.", true)
+        ->check(CLI::Range(1u, 1000u));
+    std::string affinity = "spread";
+    app.add_set("--affinity", affinity, {"none", "compact", "spread"}, "The pinning of the threads.", true);
+
+    try
+    {
+        app.parse(argc, argv);
+    }
+    catch(const CLI::ParseError& e)
+    {
+        return app.exit(e);
+    }
+
+    const uint64_t num_pixels = static_cast<uint64_t>(megapixels) << 20;
+
+    const auto mode = affinity == "compact" ? ThreadAffinity::compact
+                      : (affinity == "spread" ? ThreadAffinity::spread : ThreadAffinity::none);
+    std::cout << "threads: " << omp_get_max_threads() << ", pinned (thread:cpu): "
+              << ThreadAffinity::pin_threads(mode) << "\n\n";
+
+    std::cout << std::left << std::setw(14) << "buffers" << std::right
+              << std::setw(12) << "setup ms" << std::setw(12) << "pass ms" << std::setw(12) << "GB/s"
+              << "   pages per node\n";
+
+    {
+        // value initialized by the main thread, as std::vector does it
+        double start = omp_get_wtime();
+        std::vector<float> values(num_pixels);
+        std::vector<uint8_t> colors(num_pixels * 3);
+#pragma omp parallel for schedule(static)
+        for(uint64_t i = 0; i < num_pixels; i++)
+            values[i] = static_cast<float>(i % 1024) / 1024.f;
+        run("zeroed", values, colors, omp_get_wtime() - start, repetitions);
+    }
+
+    {
+        // first touched by the threads that work on the pixels later
+        double start = omp_get_wtime();
+        Buffer<float> values(num_pixels);
+        Buffer<uint8_t> colors(num_pixels * 3);
+#pragma omp parallel for schedule(static)
+        for(uint64_t i = 0; i < num_pixels; i++)
+        {
+            values[i] = static_cast<float>(i % 1024) / 1024.f;
+            colors[3 * i] = colors[3 * i + 1] = colors[3 * i + 2] = 0;
+        }
+        run("first touch", values, colors, omp_get_wtime() - start, repetitions);
+    }
+
+    return 0;
+}
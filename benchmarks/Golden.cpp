@@ -0,0 +1,264 @@
+// Renders the images of a corpus at a small resolution and compares them to references recorded before, so a change
+// of the evaluation that changes old images is noticed. Older images must stay reproducible, see FunctionPool.cpp.
+// The throughput of every image is compared to the throughput recorded with the references on the same machine.
+
+#include <CLI11.hpp>
+
+#include "GenerativeArt.h"
+#include "Harness.h"
+
+#include <omp.h>
+#include <sys/stat.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+std::vector<std::string> read_corpus(const std::string& file_name)
+{
+    std::ifstream in(file_name);
+    if(!in)
+        throw std::runtime_error("Could not open the corpus " + file_name + ".");
+
+    std::vector<std::string> corpus;
+    for(std::string line; std::getline(in, line);)
+    {
+        line.erase(0, line.find_first_not_of(" \t\r"));
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if(!line.empty() && line[0] != '#')
+            corpus.push_back(line);
+    }
+    return corpus;
+}
+
+std::string read_file(const std::string& file_name)
+{
+    std::ifstream in(file_name, std::ios::binary);
+    if(!in)
+        throw std::runtime_error("Could not open " + file_name + ".");
+    std::ostringstream content;
+    content << in.rdbuf();
+    return content.str();
+}
+
+/**
+ * Compares two ppm files. The headers must be equal, the colors may differ by tolerance.
+ * @return Empty if the images match, else what differs.
+ */
+std::string compare_ppm(const std::string& image, const std::string& reference, const unsigned int tolerance)
+{
+    // the header ends after the third line, see ImageWriter
+    size_t header_end = 0;
+    for(int line = 0; line < 3 && header_end != std::string::npos; line++)
+        header_end = reference.find('\n', header_end == 0 ? 0 : header_end + 1);
+    if(header_end == std::string::npos)
+        return "the reference is no ppm file";
+
+    if(image.compare(0, header_end + 1, reference, 0, header_end + 1) != 0 || image.size() != reference.size())
+        return "the size differs";
+
+    uint64_t differing = 0;
+    unsigned int max_difference = 0;
+    for(size_t i = header_end + 1; i < image.size(); i++)
+    {
+        const auto difference = static_cast<unsigned int>(std::abs(static_cast<int>(static_cast<uint8_t>(image[i]))
+                                                                   - static_cast<uint8_t>(reference[i])));
+        max_difference = std::max(max_difference, difference);
+        differing += difference > tolerance;
+    }
+
+    if(differing == 0)
+        return "";
+
+    return std::to_string(differing) + " of " + std::to_string(image.size() - header_end - 1)
+           + " color values differ, by up to " + std::to_string(max_difference);
+}
+
+std::unordered_map<std::string, double> read_throughput(const std::string& file_name)
+{
+    std::unordered_map<std::string, double> throughput;
+    std::ifstream in(file_name);
+    if(!in)
+        throw std::runtime_error("Could not open " + file_name + ", record the references first.");
+
+    std::string line;
+    std::getline(in, line);    // header
+    while(std::getline(in, line))
+    {
+        const auto comma = line.find(',');
+        if(comma != std::string::npos)
+            throughput[line.substr(0, comma)] = std::stod(line.substr(comma + 1));
+    }
+    return throughput;
+}
+
+int main(int argc, char** argv)
+{
+    CLI::App app("Compares the images of a corpus and their throughput to recorded references.");
+
+    std::string corpus_file = "benchmarks/golden.txt";
+    app.add_option("--corpus", corpus_file, "File with the file names of the images, one per line.", true);
+    std::string references = "golden/";
+    app.add_option("--references", references, "Directory of the reference images and throughput.", true);
+    bool record = false;
+    app.add_flag("--record", record, "Records the references instead of checking against them.");
+    bool record_missing = false;
+    app.add_flag("--record-missing", record_missing, "Records the references only if there are none yet, else does "
+                                                     "nothing. Used by ctest, so the references of the first run are "
+                                                     "kept and later builds are checked against them.");
+    unsigned int resolution = 128;
+    app.add_option("-r,--resolution", resolution, "The resolution the images are rendered at.", true)
+        ->check(CLI::Range(8u, 4000u));
+    unsigned int tolerance = 0;
+    app.add_option("--tolerance", tolerance, "The largest difference of a color value that still matches.", true)
+        ->check(CLI::Range(0u, 255u));
+    double budget = 0.1;
+    app.add_option("--budget", budget, "The share of the recorded throughput that may be lost, for all images "
+                                       "together. Negative skips the timing, e.g. on another machine.", true);
+    Harness::Options options;
+    options.min_time = 0.2;
+    app.add_option("--repetitions", options.repetitions, "Minimal number of samples of the throughput of every image.",
+                   true)
+        ->check(CLI::Range(1u, 1000u));
+    app.add_option("--min-time", options.min_time, "Minimal seconds spent on the samples of every image.", true);
+    std::string jit;
+    app.add_option("--jit", jit, "Renders by the random functions compiled into this directory, see --jit of "
+                                 "GenerativeArt. The references are the same.");
+    std::string work = "/tmp/";
+    app.add_option("--directory", work, "Where the images are rendered before they are compared.", true);
+
+    try
+    {
+        app.parse(argc, argv);
+    }
+    catch(const CLI::ParseError& e)
+    {
+        return app.exit(e);
+    }
+
+    if(references.back() != '/')
+        references += "/";
+    if(work.back() != '/')
+        work += "/";
+
+    try
+    {
+        const std::vector<std::string> corpus = read_corpus(corpus_file);
+        if(record_missing)
+        {
+            // the references are complete once the last image is written
+            if(!corpus.empty() && std::ifstream(references + corpus.back() + ".ppm"))
+            {
+                std::cout << "The references in " << references << " exist, nothing recorded." << std::endl;
+                return 0;
+            }
+            record = true;
+        }
+        if(record && mkdir(references.c_str(), 0755) != 0 && errno != EEXIST)
+            throw std::runtime_error("Could not create " + references + ".");
+        const bool timing = budget >= 0.0;
+        std::unordered_map<std::string, double> recorded;
+        if(!record && timing)
+            recorded = read_throughput(references + "throughput.csv");
+
+        Harness harness(options);
+        bool failed = false;
+        double pixels = 0.0;
+        double seconds = 0.0;
+        double recorded_seconds = 0.0;
+
+        for(const auto& name : corpus)
+        {
+            GenerativeArt::Settings settings;
+            settings.read_file_name(name, true, true, true);
+            settings.resolution = resolution;
+            settings.scale_resolution();
+            settings.num_samples = 1;
+            settings.format = ImageWriter::ppm;
+            settings.output_file = (record ? references : work) + name + ".ppm";
+            settings.jit = jit;
+
+            GenerativeArt ga(settings);
+            if(!ga.generate())
+            {
+                std::cout << "FAIL " << name << ": rejected" << std::endl;
+                failed = true;
+                continue;
+            }
+
+            if(!record)
+            {
+                const std::string difference = compare_ppm(read_file(settings.output_file),
+                                                           read_file(references + name + ".ppm"), tolerance);
+                if(!difference.empty())
+                {
+                    std::cout << "FAIL " << name << ": " << difference << std::endl;
+                    failed = true;
+                    continue;
+                }
+            }
+
+            if(!timing)
+            {
+                std::cout << (record ? "recorded " : "ok ") << name << std::endl;
+                continue;
+            }
+
+            const auto dim_x = static_cast<uint32_t>((settings.x.max - settings.x.min) * settings.resolution);
+            const auto dim_y = static_cast<uint32_t>((settings.y.max - settings.y.min) * settings.resolution);
+            harness.run("golden", name, static_cast<uint64_t>(dim_x) * dim_y, omp_get_max_threads(), [&]()
+            {
+                ga.generate();
+            });
+
+            const Harness::Result& result = harness.get_results().back();
+            const double throughput = result.items / result.median;
+            pixels += result.items;
+            seconds += result.median;
+
+            std::cout << (record ? "recorded " : "ok ") << name << ": " << throughput << " pixels/s";
+            if(!record && recorded.count(name))
+            {
+                recorded_seconds += result.items / recorded[name];
+                std::cout << ", " << throughput / recorded[name] << " of the reference";
+            }
+            std::cout << std::endl;
+        }
+
+        if(timing && record)
+        {
+            std::ofstream out(references + "throughput.csv");
+            if(!out)
+                throw std::runtime_error("Could not write " + references + "throughput.csv.");
+            out << "name,pixels_per_second\n" << std::setprecision(9);
+            for(const auto& result : harness.get_results())
+                out << result.name << "," << result.items / result.median << "\n";
+        }
+        else if(timing && recorded_seconds > 0.0)
+        {
+            // the images are weighted by their time, as if they were rendered one after the other
+            const double ratio = recorded_seconds / seconds;
+            std::cout << "throughput: " << pixels / seconds << " pixels/s, " << ratio << " of the reference"
+                      << std::endl;
+            if(ratio < 1.0 - budget)
+            {
+                std::cout << "FAIL throughput: more than " << budget * 100.0 << "% below the reference" << std::endl;
+                failed = true;
+            }
+        }
+
+        std::cout << (failed ? "FAILED" : (record ? "RECORDED" : "PASSED")) << std::endl;
+        return failed ? 1 : 0;
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,314 @@
+#ifndef GENERATIVEART_BENCHMARK_HARNESS_H
+#define GENERATIVEART_BENCHMARK_HARNESS_H
+
+#include "PerfCounters.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * Keeps the compiler from removing a computation whose result is not used otherwise.
+ */
+template<typename T>
+inline void keep(const T& value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+/**
+ * Times benchmark cases and collects their statistics.
+ *
+ * A case is first run until it took warmup seconds. Then the number of calls per sample is doubled until a sample
+ * takes min_sample_time seconds, so the resolution of the clock does not matter. Samples are taken until there are
+ * repetitions samples and min_time seconds are spent. The median and the median absolute deviation are robust
+ * against a sample that got interrupted by the system, the confidence interval of the median needs no assumption
+ * about the distribution of the samples.
+ *
+ * With counters the hardware events of all samples are counted, of the calling thread for single threaded cases and
+ * of the whole OpenMP team else, and reported per item.
+ */
+class Harness
+{
+public:
+    struct Options
+    {
+        unsigned int repetitions = 15;
+        double min_time = 0.5;
+        double min_sample_time = 0.01;
+        double warmup = 0.1;
+        bool counters = false;
+        // only cases whose group/name contains the filter are run
+        std::string filter;
+    };
+
+    struct Result
+    {
+        std::string group;
+        std::string name;
+        int threads;
+        // items processed by one call, e.g. pixels
+        uint64_t items;
+        uint64_t calls_per_sample;
+        // seconds per call
+        std::vector<double> samples;
+
+        double median, mean, stddev, min, max, mad;
+        // 95% confidence interval of the median
+        double ci_low, ci_high;
+
+        // the events of all samples
+        PerfCounters::Counts counts;
+    };
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    const Options options;
+    std::vector<Result> results;
+
+public:
+    explicit Harness(Options options)
+        : options(std::move(options))
+    {}
+
+    bool selected(const std::string& group, const std::string& name) const
+    {
+        return (group + "/" + name).find(options.filter) != std::string::npos;
+    }
+
+    /**
+     * Times body, which processes items items per call.
+     * @param threads The number of threads body uses, only reported.
+     */
+    template<typename Body>
+    void run(const std::string& group, const std::string& name, const uint64_t items, const int threads, Body&& body)
+    {
+        if(!selected(group, name))
+            return;
+
+        for(const auto start = clock::now(); seconds_since(start) < options.warmup;)
+            body();
+
+        uint64_t calls = 1;
+        while(time_calls(body, calls) < options.min_sample_time && calls < (uint64_t(1) << 40))
+            calls *= 2;
+
+        Result result;
+        result.group = group;
+        result.name = name;
+        result.threads = threads;
+        result.items = items;
+        result.calls_per_sample = calls;
+        const auto read_counts = [&]()
+        {
+            if(!options.counters)
+                return PerfCounters::Counts();
+            return threads > 1 ? PerfCounters::team_counts() : PerfCounters::thread_counts();
+        };
+
+        const PerfCounters::Counts start_counts = read_counts();
+        for(const auto start = clock::now();
+            result.samples.size() < options.repetitions || seconds_since(start) < options.min_time;)
+            result.samples.push_back(time_calls(body, calls) / static_cast<double>(calls));
+        result.counts = read_counts() - start_counts;
+
+        compute_statistics(result);
+        results.push_back(std::move(result));
+    }
+
+    const std::vector<Result>& get_results() const
+    {
+        return results;
+    }
+
+    void write_csv(std::ostream& out) const
+    {
+        out << "group,name,threads,items,samples,calls_per_sample,median_s,mean_s,stddev_s,min_s,max_s,mad_s,"
+               "ci95_low_s,ci95_high_s,items_per_s";
+        if(options.counters)
+        {
+            for(size_t e = 0; e < PerfCounters::num_events; e++)
+                out << "," << PerfCounters::event_name(static_cast<PerfCounters::event>(e)) << "_per_item";
+            out << ",ipc";
+        }
+        out << "\n" << std::setprecision(9);
+
+        for(const auto& r : results)
+        {
+            out << csv_string(r.group) << "," << csv_string(r.name) << "," << r.threads << "," << r.items << ","
+                << r.samples.size() << "," << r.calls_per_sample << "," << r.median << "," << r.mean << ","
+                << r.stddev << "," << r.min << "," << r.max << "," << r.mad << "," << r.ci_low << ","
+                << r.ci_high << "," << r.items / r.median;
+
+            // missing counters stay empty
+            if(options.counters)
+            {
+                for(size_t e = 0; e < PerfCounters::num_events; e++)
+                {
+                    out << ",";
+                    if(r.counts.valid[e])
+                        out << per_item(r, r.counts.values[e]);
+                }
+                out << ",";
+                if(has_ipc(r))
+                    out << ipc(r);
+            }
+            out << "\n";
+        }
+    }
+
+    /**
+     * @param context Key value pairs written into the context object, e.g. the compiler.
+     */
+    void write_json(std::ostream& out, const std::vector<std::pair<std::string, std::string>>& context) const
+    {
+        out << std::setprecision(9) << "{\n  \"context\": {";
+        for(size_t i = 0; i < context.size(); i++)
+            out << (i > 0 ? ", " : "") << json_string(context[i].first) << ": " << json_string(context[i].second);
+        out << "},\n  \"results\": [";
+
+        for(size_t i = 0; i < results.size(); i++)
+        {
+            const Result& r = results[i];
+            out << (i > 0 ? "," : "") << "\n    {\"group\": " << json_string(r.group)
+                << ", \"name\": " << json_string(r.name) << ", \"threads\": " << r.threads
+                << ", \"items\": " << r.items << ", \"calls_per_sample\": " << r.calls_per_sample
+                << ", \"median_s\": " << r.median << ", \"mean_s\": " << r.mean << ", \"stddev_s\": " << r.stddev
+                << ", \"min_s\": " << r.min << ", \"max_s\": " << r.max << ", \"mad_s\": " << r.mad
+                << ", \"ci95_s\": [" << r.ci_low << ", " << r.ci_high << "]"
+                << ", \"items_per_s\": " << r.items / r.median;
+
+            if(r.counts.any_valid())
+            {
+                out << ", \"counters_per_item\": {";
+                bool first = true;
+                for(size_t e = 0; e < PerfCounters::num_events; e++)
+                {
+                    if(!r.counts.valid[e])
+                        continue;
+                    const auto name = PerfCounters::event_name(static_cast<PerfCounters::event>(e));
+                    out << (first ? "" : ", ") << json_string(name) << ": " << per_item(r, r.counts.values[e]);
+                    first = false;
+                }
+                out << "}";
+                if(has_ipc(r))
+                    out << ", \"ipc\": " << ipc(r);
+            }
+
+            out << ", \"samples_s\": [";
+            for(size_t k = 0; k < r.samples.size(); k++)
+                out << (k > 0 ? ", " : "") << r.samples[k];
+            out << "]}";
+        }
+        out << "\n  ]\n}\n";
+    }
+
+private:
+    static double per_item(const Result& r, const uint64_t count)
+    {
+        return static_cast<double>(count) / (static_cast<double>(r.samples.size()) * r.calls_per_sample * r.items);
+    }
+
+    static bool has_ipc(const Result& r)
+    {
+        return r.counts.valid[PerfCounters::instructions] && r.counts.valid[PerfCounters::cycles]
+               && r.counts.values[PerfCounters::cycles] > 0;
+    }
+
+    static double ipc(const Result& r)
+    {
+        return static_cast<double>(r.counts.values[PerfCounters::instructions])
+               / r.counts.values[PerfCounters::cycles];
+    }
+
+    static double seconds_since(const clock::time_point start)
+    {
+        return std::chrono::duration<double>(clock::now() - start).count();
+    }
+
+    template<typename Body>
+    static double time_calls(Body& body, const uint64_t calls)
+    {
+        const auto start = clock::now();
+        for(uint64_t c = 0; c < calls; c++)
+            body();
+        return seconds_since(start);
+    }
+
+    static void compute_statistics(Result& r)
+    {
+        std::vector<double> sorted = r.samples;
+        std::sort(sorted.begin(), sorted.end());
+        const size_t n = sorted.size();
+
+        r.median = median(sorted);
+        r.min = sorted.front();
+        r.max = sorted.back();
+
+        double sum = 0.0;
+        for(const double s : sorted)
+            sum += s;
+        r.mean = sum / n;
+
+        double squares = 0.0;
+        for(const double s : sorted)
+            squares += (s - r.mean) * (s - r.mean);
+        r.stddev = n > 1 ? std::sqrt(squares / (n - 1)) : 0.0;
+
+        std::vector<double> deviations;
+        for(const double s : sorted)
+            deviations.push_back(std::fabs(s - r.median));
+        std::sort(deviations.begin(), deviations.end());
+        r.mad = median(deviations);
+
+        // the ranks n/2 -+ 1.96 sqrt(n)/2 of the sorted samples, see the binomial distribution of the ranks
+        const double half_width = 1.96 * std::sqrt(static_cast<double>(n)) / 2.0;
+        const auto low = static_cast<long>(std::floor(n / 2.0 - half_width));
+        const auto high = static_cast<long>(std::ceil(n / 2.0 + half_width));
+        r.ci_low = sorted[static_cast<size_t>(std::max(0L, low))];
+        r.ci_high = sorted[static_cast<size_t>(std::min(static_cast<long>(n) - 1, high))];
+    }
+
+    static double median(const std::vector<double>& sorted)
+    {
+        const size_t n = sorted.size();
+        return n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2.0;
+    }
+
+    static std::string csv_string(const std::string& s)
+    {
+        if(s.find_first_of(",\"\n") == std::string::npos)
+            return s;
+
+        std::string quoted = "\"";
+        for(const char c : s)
+            quoted += c == '"' ? std::string("\"\"") : std::string(1, c);
+        return quoted + "\"";
+    }
+
+    static std::string json_string(const std::string& s)
+    {
+        std::ostringstream quoted;
+        quoted << '"';
+        for(const char c : s)
+        {
+            if(c == '"' || c == '\\')
+                quoted << '\\' << c;
+            else if(static_cast<unsigned char>(c) < 0x20)
+                quoted << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c);
+            else
+                quoted << c;
+        }
+        quoted << '"';
+        return quoted.str();
+    }
+};
+
+#endif //GENERATIVEART_BENCHMARK_HARNESS_H
@@ -0,0 +1,252 @@
+// Times generate() for every combination of a number of threads, a resolution and a depth of the random functions,
+// to see where it stops scaling: at small resolutions the threads wait for each other, at large ones for the memory.
+// Writes the throughput, the parallel efficiency and the peak resident memory of every case as csv and a summary of
+// the knee points.
+
+#include <CLI11.hpp>
+
+#include "GenerativeArt.h"
+#include "Harness.h"
+#include "MemoryUsage.h"
+
+#include <omp.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+struct Case
+{
+    unsigned int depth;
+    unsigned int resolution;
+    int threads;
+    uint64_t pixels;
+    double median;
+    double mad;
+    uint64_t peak_rss;
+
+    double throughput() const
+    {
+        return pixels / median;
+    }
+};
+
+/**
+ * The powers of two up to the number of threads, and the number of threads.
+ */
+std::vector<int> default_threads()
+{
+    std::vector<int> threads;
+    const int max_threads = omp_get_max_threads();
+    for(int t = 1; t < max_threads; t *= 2)
+        threads.push_back(t);
+    threads.push_back(max_threads);
+    return threads;
+}
+
+std::string threads_name(const int threads)
+{
+    return std::to_string(threads) + (threads == 1 ? " thread" : " threads");
+}
+
+/**
+ * Thread knees: the most threads that still work with at least the efficiency threshold.
+ * Resolution knees: the smallest resolution that reaches the threshold of the best throughput of the number of
+ * threads, and the first larger one that falls below it again.
+ */
+void write_summary(std::ostream& out, const std::vector<Case>& cases, const double threshold)
+{
+    std::map<std::pair<unsigned int, unsigned int>, std::vector<const Case*>> by_resolution;
+    std::map<std::pair<unsigned int, int>, std::vector<const Case*>> by_threads;
+    std::map<std::pair<unsigned int, unsigned int>, double> single_thread;
+    for(const Case& c : cases)
+    {
+        by_resolution[{c.depth, c.resolution}].push_back(&c);
+        by_threads[{c.depth, c.threads}].push_back(&c);
+        if(c.threads == 1)
+            single_thread[{c.depth, c.resolution}] = c.throughput();
+    }
+
+    out << std::fixed << std::setprecision(2) << "Thread scaling (efficiency >= " << threshold << "):\n";
+    for(const auto& entry : by_resolution)
+    {
+        const auto base = single_thread.find(entry.first);
+        if(base == single_thread.end())
+            continue;
+
+        const Case* knee = nullptr;
+        const Case* most = nullptr;
+        for(const Case* c : entry.second)
+        {
+            if(c->throughput() / (c->threads * base->second) >= threshold && (!knee || c->threads > knee->threads))
+                knee = c;
+            if(!most || c->threads > most->threads)
+                most = c;
+        }
+
+        out << "  depth " << entry.first.first << ", resolution " << entry.first.second << ": scales to "
+            << threads_name(knee ? knee->threads : 1);
+        if(most && most != knee)
+            out << ", " << most->throughput() / (most->threads * base->second) << " efficiency at " << most->threads;
+        out << "\n";
+    }
+
+    out << "Resolution scaling (throughput >= " << threshold << " of the best):\n";
+    for(const auto& entry : by_threads)
+    {
+        auto sorted = entry.second;
+        std::sort(sorted.begin(), sorted.end(), [](const Case* a, const Case* b)
+        {
+            return a->resolution < b->resolution;
+        });
+
+        double best = 0.0;
+        for(const Case* c : sorted)
+            best = std::max(best, c->throughput());
+
+        const Case* knee = nullptr;
+        const Case* drop = nullptr;
+        for(const Case* c : sorted)
+        {
+            if(!knee && c->throughput() >= threshold * best)
+                knee = c;
+            else if(knee && !drop && c->throughput() < threshold * best)
+                drop = c;
+        }
+
+        out << "  depth " << entry.first.first << ", " << threads_name(entry.first.second) << ": full throughput from "
+            << "resolution " << knee->resolution;
+        if(drop)
+            out << ", drops to " << drop->throughput() / best << " at resolution " << drop->resolution;
+        out << "\n";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    CLI::App app("Thread and resolution scaling of generate().");
+
+    Harness::Options options;
+    options.repetitions = 3;
+    options.min_time = 0.0;
+    options.warmup = 0.0;
+    app.add_option("-r,--repetitions", options.repetitions, "Minimal number of samples of every case.", true)
+        ->check(CLI::Range(1u, 100000u));
+    app.add_option("--min-time", options.min_time, "Minimal seconds spent on the samples of every case.", true);
+
+    std::vector<int> threads = default_threads();
+    app.add_option("--threads", threads, "The numbers of threads.", true)->check(CLI::Range(1, 4096));
+    std::vector<unsigned int> resolutions = {200, 1000, 4000, 16000};
+    app.add_option("--resolutions", resolutions, "The resolutions. 16000 needs several GB of memory.", true);
+    std::vector<unsigned int> depths = {6};
+    app.add_option("--depths", depths, "The depths of the random functions.", true);
+    std::vector<unsigned int> seeds = {3235022989, 609019643};
+    app.add_option("--seeds", seeds, "The function seeds, the times of all seeds are summed.", true);
+    unsigned int color_seed = 1125252055;
+    app.add_option("--color-seed", color_seed, "The color seed of all images.", true);
+    double threshold = 0.8;
+    app.add_option("--threshold", threshold, "Efficiency and share of the best throughput that counts as scaling.",
+                   true);
+    std::string directory = "/tmp/";
+    app.add_option("--directory", directory, "Where generate() stores its images.", true);
+    std::string image_format = "png";
+    app.add_set("--image-format", image_format, {"png", "ppm", "pam", "qoi"},
+                "The file format generate() writes.", true);
+    std::string output;
+    app.add_option("-o,--output", output, "File for the csv. Empty writes it to stdout and the summary to stderr.");
+
+    try
+    {
+        app.parse(argc, argv);
+    }
+    catch(const CLI::ParseError& e)
+    {
+        return app.exit(e);
+    }
+
+    const bool reset = MemoryUsage::reset_peak();
+    if(!reset)
+        std::cerr << "warning: the peak memory cannot be reset, it is the peak of all cases so far" << std::endl;
+
+    std::vector<Case> cases;
+    Harness harness(options);
+    for(const unsigned int depth : depths)
+        for(const unsigned int resolution : resolutions)
+            for(const int t : threads)
+            {
+                omp_set_num_threads(t);
+
+                Case c{depth, resolution, t, 0, 0.0, 0.0, 0};
+                for(const unsigned int seed : seeds)
+                {
+                    GenerativeArt::Settings settings;
+                    settings.function_depth = {depth, depth};
+                    settings.random_function_seed = seed;
+                    settings.color_map_seed = color_seed;
+                    settings.resolution = resolution;
+                    settings.num_samples = 1;
+                    settings.directory = directory;
+                    settings.format = image_format == "ppm" ? ImageWriter::ppm
+                                      : (image_format == "pam" ? ImageWriter::pam
+                                         : (image_format == "qoi" ? ImageWriter::qoi : ImageWriter::png));
+                    settings.png_threads = static_cast<unsigned int>(t);
+
+                    MemoryUsage::reset_peak();
+                    GenerativeArt ga(settings);
+                    harness.run("scaling", "depth " + std::to_string(depth) + " r " + std::to_string(resolution)
+                                           + " t " + std::to_string(t) + " seed " + std::to_string(seed),
+                                static_cast<uint64_t>(resolution) * resolution, t, [&]()
+                    {
+                        ga.generate();
+                    });
+
+                    const Harness::Result& result = harness.get_results().back();
+                    c.pixels += result.items;
+                    c.median += result.median;
+                    c.mad += result.mad;
+                    c.peak_rss = std::max(c.peak_rss, MemoryUsage::peak());
+                }
+                cases.push_back(c);
+                std::cerr << "depth " << depth << ", resolution " << resolution << ", " << t << " threads: "
+                          << c.throughput() << " pixels/s" << std::endl;
+            }
+
+    std::ofstream file;
+    if(!output.empty())
+    {
+        file.open(output);
+        if(!file)
+        {
+            std::cerr << "Could not open " << output << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& out = output.empty() ? std::cout : file;
+
+    out << "depth,resolution,threads,pixels,median_s,mad_s,pixels_per_s,speedup,efficiency,peak_rss_bytes\n"
+        << std::setprecision(9);
+    for(const Case& c : cases)
+    {
+        // the speedup is relative to one thread, if one thread was timed
+        double single = 0.0;
+        for(const Case& s : cases)
+            if(s.threads == 1 && s.depth == c.depth && s.resolution == c.resolution)
+                single = s.throughput();
+
+        out << c.depth << "," << c.resolution << "," << c.threads << "," << c.pixels << "," << c.median << ","
+            << c.mad << "," << c.throughput() << ",";
+        if(single > 0.0)
+            out << c.throughput() / single << "," << c.throughput() / (single * c.threads);
+        else
+            out << ",";
+        out << "," << c.peak_rss << "\n";
+    }
+
+    write_summary(output.empty() ? std::cerr : std::cout, cases, threshold);
+
+    return 0;
+}
@@ -0,0 +1,81 @@
+#ifndef GENERATIVEART_BACKGROUND_WRITER_H
+#define GENERATIVEART_BACKGROUND_WRITER_H
+
+#include "BlockingQueue.h"
+
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+/**
+ * Thread that encodes and stores images while the caller already renders the next one. At most max_pending images
+ * wait for the thread, so the memory held by finished images is bounded. submit() blocks if the thread falls behind.
+ */
+class BackgroundWriter
+{
+    BlockingQueue<std::function<void()>> tasks;
+
+    std::mutex mutex;
+    std::exception_ptr error;
+
+    std::thread thread;
+
+public:
+    explicit BackgroundWriter(const size_t max_pending = 1)
+        : tasks(max_pending),
+          thread(&BackgroundWriter::run, this)
+    {}
+
+    BackgroundWriter(const BackgroundWriter&) = delete;
+    BackgroundWriter& operator=(const BackgroundWriter&) = delete;
+
+    ~BackgroundWriter()
+    {
+        tasks.close();
+        if(thread.joinable())
+            thread.join();
+    }
+
+    void submit(std::function<void()> task)
+    {
+        if(!tasks.push(std::move(task)))
+            throw std::logic_error("The background writer is already finished.");
+    }
+
+    /**
+     * Waits until all submitted images are stored.
+     * @throws The first exception thrown by a task.
+     */
+    void finish()
+    {
+        tasks.close();
+        if(thread.joinable())
+            thread.join();
+
+        if(error)
+            std::rethrow_exception(error);
+    }
+
+private:
+    void run()
+    {
+        std::function<void()> task;
+        while(tasks.pop(task))
+        {
+            try
+            {
+                task();
+            }
+            catch(...)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if(!error)
+                    error = std::current_exception();
+            }
+        }
+    }
+};
+
+#endif //GENERATIVEART_BACKGROUND_WRITER_H
@@ -0,0 +1,223 @@
+#ifndef GENERATIVEART_BATCH_REGENERATOR_H
+#define GENERATIVEART_BATCH_REGENERATOR_H
+
+#include "GenerativeArt.h"
+#include "BackgroundWriter.h"
+#include "RenderContext.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <signal.h>
+#include <sys/stat.h>
+
+/**
+ * Regenerates all images of a directory in one process. The settings of every image are read from its file name, the
+ * resolution, the output directory and all options that are not encoded in the file names are taken from the base
+ * settings.
+ *
+ * The largest images are rendered first, so no long job is left running alone at the end. Every image is encoded and
+ * stored by a background thread while the next one is rendered. Images whose output files already exist are skipped,
+ * so an interrupted run can simply be started again. An output file exists only when it is complete, since the
+ * images are written to temporary files that get renamed at the end (see ImageStream). The temporary files left by a
+ * killed run are removed.
+ */
+class BatchRegenerator
+{
+    struct Job
+    {
+        std::string source;
+        GenerativeArt::Settings settings;
+        uint64_t num_pixels;
+    };
+
+    const GenerativeArt::Settings& base_settings;
+
+public:
+    explicit BatchRegenerator(const GenerativeArt::Settings& settings)
+        : base_settings(settings)
+    {}
+
+    /**
+     * @return The number of images that could not be regenerated.
+     */
+    unsigned int run() const
+    {
+        std::vector<Job> jobs = collect_jobs();
+        remove_temporary_files();
+
+        // longest processing time first
+        std::stable_sort(jobs.begin(), jobs.end(), [](const Job& a, const Job& b){
+            return a.num_pixels > b.num_pixels;
+        });
+
+        unsigned int num_rendered = 0;
+        unsigned int num_skipped = 0;
+        unsigned int num_rejected = 0;
+        unsigned int num_failed = 0;
+
+        BackgroundWriter writer;
+        const auto context = std::make_shared<RenderContext>(base_settings.huge_pages);
+
+        for(size_t i = 0; i < jobs.size(); i++)
+        {
+            const Job& job = jobs[i];
+            GenerativeArt ga(job.settings, context);
+
+            if(outputs_exist(ga, job.settings))
+            {
+                num_skipped++;
+                verbose(base_settings.verbose, "Skipped " + job.source + ", the output exists.");
+                continue;
+            }
+
+            verbose(base_settings.verbose, "------------------------------------------------------------");
+            verbose(base_settings.verbose, "Regenerating " + job.source + " (" + std::to_string(i + 1) + " / "
+                                           + std::to_string(jobs.size()) + ")");
+
+            try
+            {
+                ga.set_background_writer(&writer);
+                if(ga.generate())
+                    num_rendered++;
+                else
+                    num_rejected++;
+            }
+            catch(const std::exception& e)
+            {
+                num_failed++;
+                std::cerr << "Regenerating " << job.source << " failed: " << e.what() << std::endl;
+            }
+        }
+
+        try
+        {
+            writer.finish();
+        }
+        catch(const std::exception& e)
+        {
+            num_failed++;
+            std::cerr << "Storing an image failed: " << e.what() << std::endl;
+        }
+
+        verbose(base_settings.verbose, "Regenerated " + std::to_string(num_rendered) + " images, skipped "
+                                       + std::to_string(num_skipped) + ", rejected " + std::to_string(num_rejected)
+                                       + ", failed " + std::to_string(num_failed) + ".");
+
+        return num_failed;
+    }
+
+private:
+    /**
+     * Reads the settings of all images in the directory. Files of the color permutations of an image are one job.
+     */
+    std::vector<Job> collect_jobs() const
+    {
+        DIR* dir = opendir(base_settings.regenerate_dir.c_str());
+        if(dir == nullptr)
+            throw std::runtime_error("Could not open the directory " + base_settings.regenerate_dir);
+
+        // sorted, so the order of equally sized jobs does not depend on the file system
+        std::set<std::string> file_names;
+        while(const dirent* entry = readdir(dir))
+        {
+            const std::string name = entry->d_name;
+            if(has_image_extension(name))
+                file_names.insert(name);
+        }
+        closedir(dir);
+
+        std::vector<Job> jobs;
+        std::set<std::string> images;
+
+        for(const auto& name : file_names)
+        {
+            GenerativeArt::Settings settings = base_settings;
+            try
+            {
+                settings.read_file_name(name, base_settings.file_name_pt,
+                                        base_settings.file_name_x, base_settings.file_name_y);
+            }
+            catch(const std::exception&)
+            {
+                verbose(base_settings.verbose, "Ignored " + name + ", the file name holds no settings.");
+                continue;
+            }
+
+            if(!images.insert(settings.get_file_name(settings.random_function_seed, settings.color_map_seed)).second)
+                continue;
+
+            settings.num_samples = 1;
+            if(settings.scale)
+                settings.scale_resolution();
+
+            const auto dim_x = static_cast<uint64_t>((settings.x.max - settings.x.min) * settings.resolution);
+            const auto dim_y = static_cast<uint64_t>((settings.y.max - settings.y.min) * settings.resolution);
+            jobs.push_back({name, settings, dim_x * dim_y});
+        }
+
+        return jobs;
+    }
+
+    /**
+     * Removes the temporary image files <name>.tmp.<pid> of processes that are gone from the output directory.
+     */
+    void remove_temporary_files() const
+    {
+        const std::string directory = base_settings.directory.empty() ? "." : base_settings.directory;
+        DIR* dir = opendir(directory.c_str());
+        if(dir == nullptr)
+            return;
+
+        std::vector<std::string> stale;
+        while(const dirent* entry = readdir(dir))
+        {
+            const std::string name = entry->d_name;
+            const auto tmp = name.rfind(".tmp.");
+            if(tmp == std::string::npos || !has_image_extension(name.substr(0, tmp)))
+                continue;
+
+            const std::string pid = name.substr(tmp + 5);
+            if(pid.empty() || pid.find_first_not_of("0123456789") != std::string::npos)
+                continue;
+
+            if(kill(static_cast<pid_t>(std::stol(pid)), 0) != 0 && errno == ESRCH)
+                stale.push_back(name);
+        }
+        closedir(dir);
+
+        for(const auto& name : stale)
+        {
+            std::remove((base_settings.directory + name).c_str());
+            verbose(base_settings.verbose, "Removed " + name + ", left by an interrupted run.");
+        }
+    }
+
+    static bool has_image_extension(const std::string& name)
+    {
+        const auto dot = name.find_last_of('.');
+        if(dot == std::string::npos)
+            return false;
+
+        const auto& extensions = ImageWriter::extensions();
+        return std::find(extensions.begin(), extensions.end(), name.substr(dot + 1)) != extensions.end();
+    }
+
+    static bool outputs_exist(const GenerativeArt& ga, const GenerativeArt::Settings& settings)
+    {
+        const auto outputs = ga.get_output_names(settings.random_function_seed, settings.color_map_seed);
+
+        struct stat st = {};
+        return std::all_of(outputs.begin(), outputs.end(), [&st](const std::string& output){
+            return stat(output.c_str(), &st) == 0;
+        });
+    }
+};
+
+#endif //GENERATIVEART_BATCH_REGENERATOR_H
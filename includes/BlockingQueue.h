@@ -0,0 +1,65 @@
+#ifndef GENERATIVEART_BLOCKING_QUEUE_H
+#define GENERATIVEART_BLOCKING_QUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+/**
+ * Queue with a fixed capacity. push() blocks while the queue is full, pop() blocks while it is empty.
+ */
+template<typename T>
+class BlockingQueue
+{
+    std::deque<T> items;
+    const size_t capacity;
+    bool closed = false;
+
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+
+public:
+    explicit BlockingQueue(const size_t capacity) : capacity(capacity) {}
+
+    /**
+     * @return false if the queue got closed.
+     */
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [this]{ return closed || items.size() < capacity; });
+        if(closed)
+            return false;
+
+        items.push_back(std::move(item));
+        not_empty.notify_one();
+        return true;
+    }
+
+    /**
+     * @return false if the queue got closed and is empty.
+     */
+    bool pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [this]{ return closed || !items.empty(); });
+        if(items.empty())
+            return false;
+
+        item = std::move(items.front());
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        not_empty.notify_all();
+        not_full.notify_all();
+    }
+};
+
+#endif //GENERATIVEART_BLOCKING_QUEUE_H
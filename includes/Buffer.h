@@ -0,0 +1,54 @@
+#ifndef GENERATIVEART_BUFFER_H
+#define GENERATIVEART_BUFFER_H
+
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Allocator that default initializes the values instead of value initializing them, so resizing a vector of numbers
+ * does not write zeros into it.
+ *
+ * The kernel places a page on the NUMA node of the thread that touches it first. Without the zeros the pages of an
+ * image buffer are first touched by the OpenMP threads that compute into them, instead of all landing on the node of
+ * the thread that created the buffer.
+ */
+template<typename T>
+struct DefaultInitAllocator : std::allocator<T>
+{
+    template<typename U>
+    struct rebind
+    {
+        using other = DefaultInitAllocator<U>;
+    };
+
+    DefaultInitAllocator() = default;
+
+    template<typename U>
+    DefaultInitAllocator(const DefaultInitAllocator<U>& other) noexcept
+        : std::allocator<T>(other)
+    {}
+
+    template<typename U>
+    void construct(U* p) noexcept(std::is_nothrow_default_constructible<U>::value)
+    {
+        ::new(static_cast<void*>(p)) U;
+    }
+
+    template<typename U, typename... Args>
+    void construct(U* p, Args&&... args)
+    {
+        ::new(static_cast<void*>(p)) U(std::forward<Args>(args)...);
+    }
+};
+
+/**
+ * Image buffer whose values are uninitialized after resizing. All loops that write into a buffer use
+ * schedule(static) over the pixels or rows, so the same threads touch the same parts of the buffers in every pass.
+ */
+template<typename T>
+using Buffer = std::vector<T, DefaultInitAllocator<T>>;
+
+#endif //GENERATIVEART_BUFFER_H
@@ -5,6 +5,7 @@
 #ifndef GENERATIVEART_RANDOM_COLOR_MAP_H
 #define GENERATIVEART_RANDOM_COLOR_MAP_H
 
+#include <array>
 #include <vector>
 #include <random>
 #include <cmath>
@@ -14,6 +15,8 @@
  */
 class ColorMap
 {
+    friend class FunctionBaker;
+
 public:
     enum projection_type : uint8_t {cap, periodic, smooth_periodic};
 
@@ -47,10 +50,41 @@ protected:
                 return static_cast<uint8_t>(fmax(0.0, fmin(val, 255.0)));
         }
     }
+
+    /**
+     * Bounds get_color_byte() on all values in [lo, hi]. The bounds are exact where the projection is monotonic, which
+     * is cap everywhere and periodic within a period of non negative values, else they are [0, 255].
+     */
+    void get_color_byte_bounds(const double lo, const double hi, uint8_t& min, uint8_t& max) const
+    {
+        switch(pt)
+        {
+            case periodic:
+                if(lo >= 0.0 && std::floor(lo / 256.0) == std::floor(hi / 256.0))
+                {
+                    min = static_cast<uint8_t>(fmod(lo, 256.0));
+                    max = static_cast<uint8_t>(fmod(hi, 256.0));
+                    return;
+                }
+                break;
+            case smooth_periodic:
+                break;
+            case cap:
+            default:
+                min = static_cast<uint8_t>(fmax(0.0, fmin(lo, 255.0)));
+                max = static_cast<uint8_t>(fmax(0.0, fmin(hi, 255.0)));
+                return;
+        }
+
+        min = 0;
+        max = 255;
+    }
 };
 
 class PolynomialColorMap : public ColorMap
 {
+    friend class FunctionBaker;
+
     const RandomPolynomial r_poly;
     const RandomPolynomial g_poly;
     const RandomPolynomial b_poly;
@@ -77,6 +111,36 @@ public:
         b = get_color_byte(b_poly.eval(z));
     }
 
+    /**
+     * Bounds the colors of all values in [lo, hi], see RandomPolynomial::bounds() and get_color_byte_bounds(). A single
+     * value, also NaN, gets its exact color.
+     */
+    void get_color_bounds(const argument_type lo, const argument_type hi,
+                          std::array<uint8_t, 3>& min, std::array<uint8_t, 3>& max) const
+    {
+        if(!(lo < hi))
+        {
+            get_color(lo, min[0], min[1], min[2]);
+            max = min;
+            return;
+        }
+
+        const RandomPolynomial* polys[3] = {&r_poly, &g_poly, &b_poly};
+        for(size_t i = 0; i < 3; i++)
+        {
+            double poly_min, poly_max;
+            if(polys[i]->bounds(lo, hi, poly_min, poly_max))
+            {
+                get_color_byte_bounds(poly_min, poly_max, min[i], max[i]);
+            }
+            else
+            {
+                min[i] = 0;
+                max[i] = 255;
+            }
+        }
+    }
+
     std::string print() const
     {
         return "r = " + r_poly.print() + "\n"
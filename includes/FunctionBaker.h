@@ -0,0 +1,233 @@
+#ifndef GENERATIVEART_FUNCTION_BAKER_H
+#define GENERATIVEART_FUNCTION_BAKER_H
+
+#include "FunctionPool.h"
+#include "RandomFunction.h"
+#include "ColorMap.h"
+
+#include <iomanip>
+#include <set>
+#include <sstream>
+#include <string>
+
+/**
+ * Writes a random function and a color map as straight-line C++ code, the nodes in the order of
+ * RandomFunction::print(), every parameter a float literal and every function of the pool inlined. The code gets compiled
+ * into a renderer of its own, see add_baked_renderer() in CMakeLists.txt, so the compiler optimizes this one expression.
+ * kernel() writes only the function as C code, which JitCompiler compiles at run time.
+ *
+ * The code does the same float operations in the same order as RandomFunction::eval() and
+ * PolynomialColorMap::get_color(), so the images are the same as the ones of the interpreter, as long as the compiler
+ * does not contract or reorder them (no -ffast-math, -ffp-contract=off).
+ *
+ * The file of bake() defines in the namespace baked:
+ * function_key, color_key: the keys of GenerativeArt the function and the color map were baked from
+ * eval_row(): a GenerativeArt::RowEvaluator
+ * color_row(): a GenerativeArt::ColorEvaluator
+ */
+class FunctionBaker
+{
+    std::ostringstream code;
+
+    // the next free temporary t<n>
+    unsigned int next_value = 0;
+
+public:
+    static std::string bake(const RandomFunction& rf, const std::string& function_key,
+                            const PolynomialColorMap& cm, const std::string& color_key)
+    {
+        FunctionBaker baker;
+        baker.write(rf, function_key, cm, color_key);
+        return baker.code.str();
+    }
+
+    /**
+     * A C file that defines eval_row(), a GenerativeArt::RowEvaluator, and nothing else that is exported.
+     */
+    static std::string kernel(const RandomFunction& rf)
+    {
+        FunctionBaker baker;
+        baker.code << "// f = " << rf.print() << "\n"
+                   << "\n"
+                   << "#include <math.h>\n"
+                   << "#include <stdint.h>\n"
+                   << "\n";
+        baker.write_function(rf, "");
+        return baker.code.str();
+    }
+
+private:
+    void write(const RandomFunction& rf, const std::string& function_key,
+               const PolynomialColorMap& cm, const std::string& color_key)
+    {
+        code << "// Baked by GenerativeArt --bake, do not edit. See FunctionBaker.h.\n"
+             << "//\n"
+             << "// f = " << rf.print() << "\n";
+        std::istringstream colors(cm.print());
+        for(std::string line; std::getline(colors, line);)
+            code << "// " << line << "\n";
+
+        code << "\n"
+             << "#include <cmath>\n"
+             << "#include <cstdint>\n"
+             << "\n"
+             << "namespace baked\n"
+             << "{\n"
+             << "constexpr const char* function_key = " << string_literal(function_key) << ";\n"
+             << "constexpr const char* color_key = " << string_literal(color_key) << ";\n"
+             << "\n";
+
+        write_function(rf, "inline ");
+        code << "\n";
+        write_color_map(cm);
+
+        code << "}\n";
+    }
+
+    /**
+     * Writes the used functions of the pool, eval() and eval_row() in code that compiles as C and as C++.
+     * @param row_specifier Written in front of eval_row().
+     */
+    void write_function(const RandomFunction& rf, const std::string& row_specifier)
+    {
+        std::set<unsigned int> unary;
+        std::set<unsigned int> binary;
+        used_functions(rf, unary, binary);
+
+        code << "// the functions of the pool\n";
+        for(const unsigned int f : unary)
+            code << "static inline float u" << f << "(const float a)\n"
+                 << "{\n"
+                 << "    return " << FunctionPool::unary_code[f] << ";\n"
+                 << "}\n";
+        for(const unsigned int f : binary)
+            code << "static inline float b" << f << "(const float a, const float b)\n"
+                 << "{\n"
+                 << "    return " << FunctionPool::binary_code[f] << ";\n"
+                 << "}\n";
+
+        code << "\n"
+             << "static inline float eval(const float x, const float y)\n"
+             << "{\n";
+        const std::string result = write_node(rf);
+        const std::string indent(row_specifier.size(), ' ');
+        code << "    return " << result << ";\n"
+             << "}\n"
+             << "\n"
+             << "// the pixels (x_px + i * stride, y) of a row, exactly like GenerativeArt::evaluate()\n"
+             << row_specifier << "void eval_row(const float y, const uint64_t x_px, const uint32_t stride, "
+                                 "const uint32_t width,\n"
+             << indent << "              const float step_size, const float x_min, float* values)\n"
+             << "{\n"
+             << "    for(uint32_t i = 0; i < width; i++)\n"
+             << "        values[i] = eval((float)(x_px + (uint64_t)i * stride) * step_size + x_min, y);\n"
+             << "}\n";
+    }
+
+    static void used_functions(const RandomFunction& rf, std::set<unsigned int>& unary, std::set<unsigned int>& binary)
+    {
+        if(rf.type == RandomFunction::unary)
+            unary.insert(rf.function_index);
+        if(rf.type == RandomFunction::binary)
+            binary.insert(rf.function_index);
+
+        if(rf.child_function_1)
+            used_functions(*rf.child_function_1, unary, binary);
+        if(rf.child_function_2)
+            used_functions(*rf.child_function_2, unary, binary);
+    }
+
+    /**
+     * Writes the children, then the node, as in RandomFunction::eval().
+     * @return The name of the temporary of the value of the node.
+     */
+    std::string write_node(const RandomFunction& rf)
+    {
+        std::string call;
+        switch(rf.type)
+        {
+            case RandomFunction::unary:
+            {
+                const std::string a = write_node(*rf.child_function_1);
+                call = "u" + std::to_string(rf.function_index) + "(" + a + ")";
+                break;
+            }
+            case RandomFunction::binary:
+            {
+                const std::string a = write_node(*rf.child_function_1);
+                const std::string b = write_node(*rf.child_function_2);
+                call = "b" + std::to_string(rf.function_index) + "(" + a + ", " + b + ")";
+                break;
+            }
+            default:
+                call = rf.function_index ? "x" : "y";
+        }
+
+        const std::string name = "t" + std::to_string(next_value++);
+        code << "    const float " << name << " = " << literal(rf.param) << " * " << call << ";\n";
+        return name;
+    }
+
+    void write_color_map(const PolynomialColorMap& cm)
+    {
+        // the same operations as ColorMap::get_color_byte()
+        code << "static inline uint8_t color_byte(const float val)\n"
+             << "{\n";
+        switch(cm.pt)
+        {
+            case ColorMap::periodic:
+                code << "    return static_cast<uint8_t>(fmod(val, 256.0));\n";
+                break;
+            case ColorMap::smooth_periodic:
+                code << "    const float x = static_cast<float>(fmod(val, 2.0));\n"
+                     << "    return static_cast<uint8_t>(x * x * (x - 2) * (x - 2) * 255.0);\n";
+                break;
+            case ColorMap::cap:
+            default:
+                code << "    return static_cast<uint8_t>(fmax(0.0, fmin(val, 255.0)));\n";
+        }
+        code << "}\n"
+             << "\n"
+             << "inline void color_row(const float* values, const uint64_t num_pixels, uint8_t* colors)\n"
+             << "{\n"
+             << "    for(uint64_t i = 0; i < num_pixels; i++)\n"
+             << "    {\n"
+             << "        const float z = values[i];\n"
+             << "        colors[3 * i] = color_byte(" << horner(cm.r_poly) << ");\n"
+             << "        colors[3 * i + 1] = color_byte(" << horner(cm.g_poly) << ");\n"
+             << "        colors[3 * i + 2] = color_byte(" << horner(cm.b_poly) << ");\n"
+             << "    }\n"
+             << "}\n";
+    }
+
+    // Horner's scheme of z, as in RandomPolynomial::eval()
+    static std::string horner(const RandomPolynomial& polynomial)
+    {
+        std::string result = literal(polynomial.poly[0]);
+        for(size_t i = 1; i < polynomial.poly.size(); i++)
+            result = (i > 1 ? "(" + result + ")" : result) + " * z + " + literal(polynomial.poly[i]);
+        return result;
+    }
+
+    // 9 significant digits restore every float exactly, the point makes integral values float literals
+    static std::string literal(const argument_type value)
+    {
+        std::ostringstream out;
+        out << std::showpoint << std::setprecision(9) << value << "f";
+        return "(" + out.str() + ")";
+    }
+
+    static std::string string_literal(const std::string& text)
+    {
+        std::string literal = "\"";
+        for(const char c : text)
+        {
+            if(c == '"' || c == '\\')
+                literal += '\\';
+            literal += c;
+        }
+        return literal + "\"";
+    }
+};
+
+#endif //GENERATIVEART_FUNCTION_BAKER_H
@@ -24,6 +24,10 @@ struct FunctionPool
 
     const static std::vector<binary_function> binary;
     const static std::vector<binary_function_discription> binary_string;
+
+    // the bodies of the functions as C code of the arguments a and b, for the baked functions, see FunctionBaker
+    const static std::vector<std::string> unary_code;
+    const static std::vector<std::string> binary_code;
 };
 
 #endif //GENERATIVEART_FUNCTION_POOL_H
@@ -11,12 +11,38 @@
 #include <png.hpp>
 #include <omp.h>
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <sstream>
 
 #include "RandomFunction.h"
 #include "ColorMap.h"
+#include "PngEncoder.h"
+#include "ImageWriter.h"
+#include "ValueCache.h"
+#include "ValueHistogram.h"
+#include "Buffer.h"
+#include "RenderContext.h"
+#include "Profiler.h"
+#include "NodeProfile.h"
+#include "FunctionBaker.h"
+#include "JitCompiler.h"
+#include "MemoryUsage.h"
+#include "ThreadAffinity.h"
+#include "BackgroundWriter.h"
+#include "RenderCache.h"
+#include "SeedStream.h"
+#include "WorkerPool.h"
 
 #include <unordered_map>
 
+#include <cerrno>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
 // Helper to make verbose easier.
 void verbose(bool on, const std::string& msg, bool new_line = true)
 {
@@ -30,7 +56,7 @@ void verbose(bool on, const std::string& msg, bool new_line = true)
 
 constexpr char delimiter = '.';
 
-constexpr uint32_t pos_to_index(uint32_t x, uint32_t y, uint32_t max_x, uint32_t /*max_y*/)
+constexpr uint64_t pos_to_index(uint64_t x, uint64_t y, uint64_t max_x, uint64_t /*max_y*/)
 {
     return y * max_x + x;
 //    return x * max_y + y;
@@ -61,17 +87,15 @@ constexpr int float_to_int(float a)
 }
 
 template<typename T>
-std::tuple<double, double, double> get_color_variances(const std::vector<T>& colors,
+std::tuple<double, double, double> get_color_variances(const T* colors, const uint64_t num_pixels,
                                                        double mean_r, double mean_g, double mean_b)
 {
-    const size_t num_pixels =  colors.size() / 3;
-
     double var_r = 0.0,
            var_g = 0.0,
            var_b = 0.0;
 
-#pragma omp parallel for reduction(+:var_r,var_g,var_b)
-    for(size_t i = 0; i < num_pixels; i++)
+#pragma omp parallel for schedule(static) reduction(+:var_r,var_g,var_b)
+    for(uint64_t i = 0; i < num_pixels; i++)
     {
         var_r += pow(colors[3 * i] - mean_r, 2.0);
         var_g += pow(colors[3 * i + 1] - mean_g, 2.0);
@@ -85,9 +109,67 @@ std::tuple<double, double, double> get_color_variances(const std::vector<T>& col
     return std::tie(var_r, var_g, var_b);
 }
 
+/**
+ * The statistics of a colored image that are used to reject single color images and to normalize the colors.
+ */
+struct ColorStatistics
+{
+    uint64_t num_pixels = 0;
+
+    uint64_t acc_r = 0, acc_g = 0, acc_b = 0;
+    uint8_t  min_r = 255, min_g = 255, min_b = 255;
+    uint8_t  max_r = 0, max_g = 0, max_b = 0;
+
+    uint64_t white = 0,
+             black = 0;
+
+    double mean_r = 0.0, mean_g = 0.0, mean_b = 0.0;
+    double var_r = 0.0, var_g = 0.0, var_b = 0.0;
+
+    void add(const uint8_t r, const uint8_t g, const uint8_t b)
+    {
+        white += close_to_white(r, g, b);
+        black += close_to_black(r, g, b);
+        acc_r += r;
+        acc_g += g;
+        acc_b += b;
+        min_r = std::min(min_r, r);
+        min_g = std::min(min_g, g);
+        min_b = std::min(min_b, b);
+        max_r = std::max(max_r, r);
+        max_g = std::max(max_g, g);
+        max_b = std::max(max_b, b);
+    }
+
+    void merge(const ColorStatistics& other)
+    {
+        num_pixels += other.num_pixels;
+        white += other.white;
+        black += other.black;
+        acc_r += other.acc_r;
+        acc_g += other.acc_g;
+        acc_b += other.acc_b;
+        min_r = std::min(min_r, other.min_r);
+        min_g = std::min(min_g, other.min_g);
+        min_b = std::min(min_b, other.min_b);
+        max_r = std::max(max_r, other.max_r);
+        max_g = std::max(max_g, other.max_g);
+        max_b = std::max(max_b, other.max_b);
+    }
+
+    void compute_means()
+    {
+        mean_r = static_cast<double>(acc_r) / num_pixels;
+        mean_g = static_cast<double>(acc_g) / num_pixels;
+        mean_b = static_cast<double>(acc_b) / num_pixels;
+    }
+};
+
 class GenerativeArt
 {
 public:
+    enum tile_layout : uint8_t {no_tiles, dzi, xyz};
+
     struct Settings
     {
         // ------------------------------------------------------
@@ -105,6 +187,80 @@ public:
         unsigned int random_function_seed = 0;
         unsigned int color_map_seed = 0;
 
+        // derive the seeds from a counter based stream instead of the random device, see SeedStream.
+        bool seed_stream = false;
+        uint64_t seed_stream_base = 0;
+        uint64_t seed_index = 0;
+        unsigned int shard = 0;
+        unsigned int num_shards = 1;
+
+        // unix socket the render server listens on. Empty means no server.
+        std::string serve_socket;
+        unsigned int queue_size = 64;
+
+        // number of threads used to deflate the png files. 1 uses libpng.
+        unsigned int png_threads = 1;
+        // zlib compression level (0-9) and row filter of the png files.
+        unsigned int png_level = 6;
+        PngEncoder::filter_type png_filter = PngEncoder::adaptive;
+
+        ImageWriter::format format = ImageWriter::png;
+
+        // memory in MiB the image buffers may use. Larger images are rendered in bands. 0 means no limit.
+        unsigned int memory_budget = 0;
+
+        // screen random color maps on a histogram of the values before the full image gets colored. Only color maps
+        // that the full check would reject are rejected, so the images are the same.
+        bool prescreen = true;
+
+        // number of color maps applied to every random function
+        unsigned int color_variants = 1;
+
+        // path of the output file. If empty the file is stored in directory and named by get_file_name().
+        std::string output_file;
+
+        // directory for the values of the random functions. Empty disables the cache.
+        std::string value_cache;
+
+        // directory of the index of rendered images. Empty disables the cache.
+        std::string render_cache;
+
+        // number of processes that render the tiles of an image. 1 renders in this process.
+        unsigned int workers = 1;
+
+        // pinning of the OpenMP threads to cpus
+        ThreadAffinity::mode affinity = ThreadAffinity::none;
+
+        // back the image buffers by transparent huge pages
+        bool huge_pages = false;
+
+        // file the stage times of all samples are written to as json. Empty disables the profiling.
+        std::string profile;
+        // count the hardware events of the stages in the profile
+        bool perf_counters = false;
+        // file the events of all threads are written to in the Chrome trace format. Empty disables the tracing.
+        std::string trace;
+        // print the time and the NaN, infinite and denormal values of every node of the random functions
+        bool profile_nodes = false;
+        // file the random function and the color map of the seeds are written to as C++ code, see FunctionBaker
+        std::string bake;
+        // directory of the random functions compiled at run time, see JitCompiler. Empty interprets them.
+        std::string jit;
+
+        // export a tile pyramid instead of a single image
+        tile_layout tiles = no_tiles;
+        uint32_t tile_size = 256;
+
+        // directory whose images are regenerated in one run. Empty means no batch run.
+        std::string regenerate_dir;
+        // the settings read from the file names of the batch run. Options set on the command line win.
+        bool file_name_pt = true;
+        bool file_name_x = true;
+        bool file_name_y = true;
+
+        // adjust the resolution to the domain, see scale_resolution()
+        bool scale = true;
+
         // ------------------------------------------------------
         // Settings for the image generator
         // ------------------------------------------------------
@@ -138,14 +294,17 @@ public:
             const size_t num_options = 17;
             std::vector<std::string> settings(num_options);
 
-            const auto end_of_file_name = file_name.find("png");
+            // the position of the file extension, if there is any.
+            auto end_of_file_name = std::string::npos;
+            for(const auto& extension : ImageWriter::extensions())
+                end_of_file_name = std::min(end_of_file_name, file_name.find(extension));
 
             for(size_t i = 0, last = 0, next = 0; i < num_options; i++)
             {
                 next = file_name.find(delimiter, last);
                 if(next >= end_of_file_name)
                 {
-                    // the last item and ".png" is not part of the file name
+                    // the last item and the file extension is not part of the file name
                     if(i == num_options - 1 && end_of_file_name == std::string::npos)
                     {
                         settings[i] = file_name.substr(last); // use the rest of the file name for the last option
@@ -197,6 +356,20 @@ public:
                 };
         }
 
+        /**
+         * Adjusts the resolution, such that the shortest edge of the image has at least resolution pixels.
+         * @return true if the resolution changed.
+         */
+        bool scale_resolution()
+        {
+            const float min_edge_length = std::fmin(x.max - x.min, y.max - y.min);
+            if(min_edge_length >= 1)
+                return false;
+
+            resolution = static_cast<unsigned int>(resolution / min_edge_length + 1);
+            return true;
+        }
+
         /**
          * Return all data necessary to regenerate the image.
          * @return An file name without extension
@@ -228,140 +401,1392 @@ public:
 private:
     const Settings& settings;
 
+    BackgroundWriter* background_writer = nullptr;
+
+    // shared with the background writer, which may store images after this object is gone
+    std::shared_ptr<const RenderCache> render_cache;
+
+    std::unique_ptr<SeedStream> seed_stream;
+
+    // the histogram of the prescreening, reused for every image
+    ValueHistogram value_histogram;
+
+    // the buffers of the images, also shared with the background writer
+    std::shared_ptr<RenderContext> context;
+
+    const WorkerPool* worker_pool = nullptr;
+
+    Profiler* profiler = nullptr;
+
+public:
+    /**
+     * Evaluates the pixels (x_px + i * stride) * step_size + x_min for i < width of the row y into values, like
+     * evaluate(), see FunctionBaker.
+     */
+    using RowEvaluator = JitCompiler::RowEvaluator;
+    /**
+     * Maps num_pixels values to 3 * num_pixels colors, like PolynomialColorMap::get_color(), see FunctionBaker.
+     */
+    using ColorEvaluator = void (*)(const argument_type* values, uint64_t num_pixels, uint8_t* colors);
+
+private:
+    // compiles the random functions that are not baked
+    std::unique_ptr<JitCompiler> jit;
+
+    // the baked function and color map and the keys of the random function and color map they were baked from
+    std::string baked_function_key;
+    RowEvaluator baked_function = nullptr;
+    std::string baked_color_key;
+    ColorEvaluator baked_color_map = nullptr;
+
+    // the baked function and color map if they belong to the image that gets rendered, else nullptr
+    RowEvaluator row_evaluator = nullptr;
+    ColorEvaluator color_evaluator = nullptr;
+
+    /**
+     * Message from the coordinator to the workers. The coordinator sends begin_image together with the file
+     * descriptor of the shared colors, then tiles, each answered by its ColorStatistics, and end_image.
+     */
+    struct TileRequest
+    {
+        enum request_type : uint32_t {begin_image, tile, end_image};
+
+        request_type type;
+        uint32_t function_seed;
+        uint32_t color_seed;
+        uint32_t dim_x;
+        uint32_t dim_y;
+        uint32_t x;
+        uint32_t y;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    // edge length of the tiles the workers render
+    static constexpr uint32_t worker_tile_size = 512;
+
+    // pixels a baked color map maps at once, the colors are still in the cache when the statistics are collected
+    static constexpr uint64_t color_block = 1024;
+
+    // the criteria of single color images, see accept() and prescreen(): every channel spans less than the range, more
+    // than the share of the pixels is white or black, or every channel has less than the variance
+    static constexpr int single_color_range = 5;
+    static constexpr double single_color_share = 0.85;
+    static constexpr double single_color_variance = 0.01;
+
 public:
-    explicit GenerativeArt(const Settings& settings)
-        : settings(settings)
+    /**
+     * @param context The buffers of the images. Generators that render one after another can share a context, so the
+     * buffers are allocated only once. If none is given, the generator gets its own.
+     */
+    explicit GenerativeArt(const Settings& settings, std::shared_ptr<RenderContext> context = nullptr)
+        : settings(settings),
+          render_cache(settings.render_cache.empty() ? nullptr : std::make_shared<const RenderCache>(settings.render_cache)),
+          seed_stream(settings.seed_stream ? new SeedStream(settings.seed_stream_base, settings.shard,
+                                                            settings.num_shards, settings.seed_index) : nullptr),
+          context(context ? std::move(context) : std::make_shared<RenderContext>(settings.huge_pages)),
+          jit(settings.jit.empty() ? nullptr : new JitCompiler(settings.jit))
     {}
 
-    bool generate() const
+    /**
+     * Renders the images of generate() by the given worker processes. The workers must run serve_tiles() with the
+     * same settings. Tiles, banded images, color variants and the value cache do not use the workers.
+     */
+    void set_worker_pool(const WorkerPool* pool)
+    {
+        worker_pool = pool;
+    }
+
+    /**
+     * The main function of a worker process. Renders the tiles the coordinator requests until it closes the socket.
+     */
+    static void serve_tiles(const Settings& settings, const int fd)
+    {
+        // the workers share the cores
+        omp_set_num_threads(std::max(1, omp_get_max_threads() / static_cast<int>(settings.workers)));
+
+        const GenerativeArt ga(settings);
+        std::unique_ptr<const RandomFunction> rf;
+        std::unique_ptr<const PolynomialColorMap> cm;
+        SharedMemory colors;
+
+        TileRequest request = {};
+        int shared_fd = -1;
+        while(WorkerPool::receive(fd, &request, sizeof(request), &shared_fd))
+        {
+            switch(request.type)
+            {
+                case TileRequest::begin_image:
+                    if(shared_fd < 0)
+                        throw std::runtime_error("The colors of the image are missing.");
+                    colors.attach(shared_fd, static_cast<size_t>(request.dim_x) * request.dim_y * 3);
+                    rf = ga.draw_function(request.function_seed);
+                    cm.reset(new PolynomialColorMap(ga.draw_color_map(request.color_seed)));
+                    break;
+                case TileRequest::tile:
+                {
+                    const ColorStatistics stats = ga.render_tile(*rf, *cm, request.dim_x, request.x, request.y,
+                                                                 request.width, request.height, colors.data());
+                    WorkerPool::send(fd, &stats, sizeof(stats));
+                    break;
+                }
+                case TileRequest::end_image:
+                    colors.reset();
+                    break;
+            }
+        }
+    }
+
+    /**
+     * Stores the images of generate() on the given thread instead of the calling one. Banded images and tiles are
+     * always written by the calling thread.
+     * @param writer Must outlive all images it gets. nullptr writes on the calling thread.
+     */
+    void set_background_writer(BackgroundWriter* writer)
+    {
+        background_writer = writer;
+    }
+
+    /**
+     * Records the stage times of every sample of generate().
+     * @param p Must outlive this object. nullptr stops the profiling.
+     */
+    void set_profiler(Profiler* p)
+    {
+        profiler = p;
+    }
+
+    /**
+     * Evaluates the random function and the color map of the keys by compiled code instead of the interpreter, see
+     * bake(). Other seeds and the worker processes use the interpreter.
+     * @param function_key, color_key See function_key() and color_key().
+     */
+    void set_baked(const std::string& function_key, const RowEvaluator eval_row,
+                   const std::string& color_key, const ColorEvaluator color_row)
+    {
+        baked_function_key = function_key;
+        baked_function = eval_row;
+        baked_color_key = color_key;
+        baked_color_map = color_row;
+    }
+
+    /**
+     * Writes the random function and the color map of the seeds of the settings as C++ code to file_name, see
+     * FunctionBaker. A renderer compiled with this file renders these seeds faster, see set_baked().
+     */
+    void bake(const std::string& file_name) const
+    {
+        const unsigned int function_seed = settings.random_function_seed;
+        const unsigned int color_seed = settings.color_map_seed;
+
+        std::ofstream out(file_name);
+        out << FunctionBaker::bake(*draw_function(function_seed), function_key(function_seed),
+                                   draw_color_map(color_seed), color_key(color_seed));
+        if(!out)
+            throw std::runtime_error("Could not write " + file_name);
+
+        verbose(settings.verbose, "Baked the function " + std::to_string(function_seed) + " and the color map "
+                                  + std::to_string(color_seed) + " into " + file_name);
+    }
+
+    bool generate()
     {
         // todo random device is used to seed the random number generators. This does maybe not work on some systems...
         std::random_device rd;
 
-        unsigned int function_seed = settings.random_function_seed ? settings.random_function_seed : rd();
-        unsigned int color_seed = settings.color_map_seed ? settings.color_map_seed : rd();
+        unsigned int function_seed;
+        unsigned int color_seed;
+
+        if(seed_stream)
+        {
+            const uint64_t index = seed_stream->next_index();
+            std::tie(function_seed, color_seed) = seed_stream->seeds(index);
+            verbose(settings.verbose, "Seed Index:    " + std::to_string(index));
+        }
+        else
+        {
+            function_seed = settings.random_function_seed ? settings.random_function_seed : rd();
+            color_seed = settings.color_map_seed ? settings.color_map_seed : rd();
+        }
 
         verbose(settings.verbose, "Function Seed: " + std::to_string(function_seed));
         verbose(settings.verbose, "Color Seed:    " + std::to_string(color_seed));
 
-        // draw the random function
+        if(!profiler && !settings.verbose)
+            return render(function_seed, color_seed);
+
+        // the peak of this image only, the images stored by the background writer are not included
+        MemoryUsage::reset_peak();
+
+        const auto dim_x = static_cast<uint32_t>((settings.x.max - settings.x.min) * settings.resolution);
+        const auto dim_y = static_cast<uint32_t>((settings.y.max - settings.y.min) * settings.resolution);
+
+        if(profiler)
+            profiler->begin_sample(function_seed, color_seed);
+        const bool accepted = render(function_seed, color_seed);
+        const uint64_t peak_rss = MemoryUsage::peak();
+        if(profiler)
+            profiler->end_sample(static_cast<uint64_t>(dim_x) * dim_y, accepted, peak_rss);
+
+        verbose(settings.verbose, "Memory: peak resident memory of the process " + MemoryUsage::megabytes(peak_rss));
+        return accepted;
+    }
+
+    /**
+     * Draws the random function of a seed. The depth is drawn first, then the function.
+     */
+    std::unique_ptr<const RandomFunction> draw_function(const unsigned int function_seed) const
+    {
         std::default_random_engine function_prng(function_seed);
         std::uniform_int_distribution<unsigned int> depth_dist(settings.function_depth.min,
                                                                settings.function_depth.max);
 
-        const RandomFunction rf(function_prng, depth_dist(function_prng),
-                                settings.function_param,
-                                settings.unary_function_pool_size,
-                                settings.binary_function_pool_size);
+        return std::unique_ptr<const RandomFunction>(new RandomFunction(function_prng, depth_dist(function_prng),
+                                                                        settings.function_param,
+                                                                        settings.unary_function_pool_size,
+                                                                        settings.binary_function_pool_size));
+    }
+
+    /**
+     * Draws the color map of a seed.
+     */
+    PolynomialColorMap draw_color_map(const unsigned int color_seed) const
+    {
+        std::default_random_engine color_prng(color_seed);
+
+        return PolynomialColorMap(color_prng,
+                                  settings.pt,
+                                  settings.color_poly_deg,
+                                  settings.color_poly_param);
+    }
+
+    /**
+     * Renders a tile of an image.
+     * @param colors The colors of the whole image with dim_x pixels per row. Only the tile gets written.
+     * @return The statistics of the tile.
+     */
+    ColorStatistics render_tile(const RandomFunction& rf, const PolynomialColorMap& cm, const uint32_t dim_x,
+                                const uint32_t x, const uint32_t y, const uint32_t width, const uint32_t height,
+                                uint8_t* colors) const
+    {
+        const uint64_t num_pixels = static_cast<uint64_t>(width) * height;
+        std::vector<argument_type> values(num_pixels);
+        std::vector<uint8_t> tile(num_pixels * 3);
+
+        evaluate(rf, x, y, width, height, 1, values.data());
+        const ColorStatistics stats = apply_color_map(cm, values.data(), num_pixels, tile.data());
+
+        const size_t row_bytes = 3 * static_cast<size_t>(width);
+        for(uint32_t j = 0; j < height; j++)
+            std::copy(tile.begin() + j * row_bytes, tile.begin() + (j + 1) * row_bytes,
+                      colors + 3 * pos_to_index(x, y + j, dim_x, 0));
+
+        return stats;
+    }
+
+    /**
+     * The path of the output file(s) without the file extension.
+     */
+    std::string get_base_name(const unsigned int function_seed, const unsigned int color_seed) const
+    {
+        if(settings.output_file.empty())
+            return settings.directory + settings.get_file_name(function_seed, color_seed);
+
+        // strip the extension, the format decides about it.
+        const auto slash = settings.output_file.find_last_of('/');
+        const auto dot = settings.output_file.find_last_of('.');
+        if(dot != std::string::npos && (slash == std::string::npos || dot > slash))
+            return settings.output_file.substr(0, dot);
+        return settings.output_file;
+    }
+
+    /**
+     * The paths of the output files. These are either one file or six files with all color permutations.
+     */
+    std::vector<std::string> get_output_names(const unsigned int function_seed, const unsigned int color_seed) const
+    {
+        const std::string base_name = get_base_name(function_seed, color_seed);
+        const std::string extension = "." + ImageWriter::extension(settings.format);
+
+        if(!settings.generate_all_color_permutations)
+            return {base_name + extension};
+
+        std::vector<std::string> names;
+        for(int i = 1; i <= 6; i++)
+            names.push_back(base_name + "." + std::to_string(i) + extension);
+        return names;
+    }
+
+private:
+    /**
+     * Renders the image(s) of the seeds, see generate().
+     */
+    bool render(const unsigned int function_seed, const unsigned int color_seed)
+    {
+        if(use_render_cache() && render_cache->restore(render_cache_key(function_seed, color_seed),
+                                                       get_output_names(function_seed, color_seed)))
+        {
+            verbose(settings.verbose, "Linked the image(s) from the render cache.");
+            return true;
+        }
+
+        // draw the random function
+        Profiler::Scope draw_function_time(profiler, Profiler::draw_function);
+        const auto function = draw_function(function_seed);
+        const RandomFunction& rf = *function;
+        draw_function_time.stop();
 
         verbose(settings.verbose, "Function:\nf = " + rf.print());
         verbose(settings.verbose, "depth: " + std::to_string(rf.get_depth()));
 
-        // draw the color map
-        std::default_random_engine color_prng(color_seed);
+        if(settings.profile_nodes)
+        {
+            const NodeProfile node_profile(rf, settings.x, settings.y);
+            std::cout << "Node profile of " << function_seed << ": " << node_profile.print() << "\n"
+                      << node_profile.print_functions() << std::flush;
+        }
 
-        const PolynomialColorMap cm(color_prng,
-                                    settings.pt,
-                                    settings.color_poly_deg,
-                                    settings.color_poly_param);
+        // draw the color map
+        Profiler::Scope draw_color_map_time(profiler, Profiler::draw_color_map);
+        const PolynomialColorMap cm = draw_color_map(color_seed);
+        draw_color_map_time.stop();
 
         verbose(settings.verbose, "Color:\n" + cm.print());
 
+        row_evaluator = baked_function && baked_function_key == function_key(function_seed) ? baked_function : nullptr;
+        color_evaluator = baked_color_map && baked_color_key == color_key(color_seed) ? baked_color_map : nullptr;
+        if(row_evaluator)
+            verbose(settings.verbose, "The function is baked.");
+        if(color_evaluator)
+            verbose(settings.verbose, "The color map is baked.");
+
+        if(!row_evaluator && jit)
+        {
+            Profiler::Scope compile_time(profiler, Profiler::compile);
+            bool compiled = false;
+            row_evaluator = jit->compile(rf, compiled);
+            compile_time.stop();
+
+            if(row_evaluator)
+                verbose(settings.verbose, compiled ? "The function is compiled." : "The function was compiled before.");
+            else
+                verbose(settings.verbose, "The function is interpreted, it cannot be compiled. See the log in "
+                                          + jit->get_directory());
+        }
+
         // prepare for generation
         const auto dim_x = static_cast<uint32_t>((settings.x.max - settings.x.min) * settings.resolution);
         const auto dim_y = static_cast<uint32_t>((settings.y.max - settings.y.min) * settings.resolution);
-        const auto num_pixels = dim_x * dim_y;
-        const auto step_size = 1.f / static_cast<argument_type>(settings.resolution);
+        const uint64_t num_pixels = static_cast<uint64_t>(dim_x) * dim_y;
 
-        std::vector<argument_type> values(num_pixels);
+        if(settings.tiles != no_tiles)
+            return generate_tiles(rf, cm, dim_x, dim_y, function_seed, color_seed);
+
+        const strategy s = choose_strategy(dim_x, dim_y);
+        const uint64_t estimated_bytes = estimate_peak_bytes(s, dim_x, dim_y);
+        verbose(settings.verbose, std::string("Memory: ") + strategy_name(s) + ", estimated peak of the image buffers "
+                                  + MemoryUsage::megabytes(estimated_bytes));
+        if(settings.memory_budget > 0 && estimated_bytes > memory_budget_bytes())
+            verbose(settings.verbose, "Memory: the image does not fit into the budget, even when it is rendered in "
+                                      "bands.");
+        if(profiler)
+            profiler->set_memory_estimate(strategy_name(s), estimated_bytes);
+
+        if(s == banded)
+            return generate_banded(rf, cm, dim_x, dim_y, function_seed, color_seed);
+
+        if(s == values_in_bands)
+            return generate_values_in_bands(rf, cm, dim_x, dim_y, function_seed, color_seed);
+
+        if(worker_pool && settings.value_cache.empty() && settings.color_variants == 1)
+            return generate_distributed(dim_x, dim_y, function_seed, color_seed);
 
-#pragma omp parallel for
-        for(uint32_t y_px = 0; y_px < dim_y; y_px++)
+        std::unique_ptr<MappedValues> cached_values;
+        const argument_type* values;
+
+        if(!settings.value_cache.empty())
+        {
+            cached_values = load_or_evaluate(rf, function_seed, dim_x, dim_y);
+            values = cached_values->data();
+        }
+        else
         {
-            const argument_type y = static_cast<argument_type>(y_px) * step_size + settings.y.min;
-            for(uint32_t x_px = 0; x_px < dim_x; x_px++)
+            argument_type* value_buffer = context->get_values(num_pixels);
+            evaluate(rf, 0, 0, dim_x, dim_y, 1, value_buffer);
+            values = value_buffer;
+        }
+
+        // color maps of fixed color seeds are always checked on the full image
+        Profiler::Scope prescreen_time(profiler, Profiler::prescreen);
+        const ValueHistogram* histogram = nullptr;
+        if(settings.prescreen && settings.color_map_seed == 0)
+        {
+            value_histogram.compute(values, num_pixels);
+            histogram = &value_histogram;
+        }
+        prescreen_time.stop();
+
+        if(settings.color_variants > 1)
+            return generate_color_variants(cm, values, histogram, dim_x, dim_y, function_seed, color_seed);
+
+        if(histogram && !prescreen(*histogram, cm))
+            return false;
+
+        Buffer<uint8_t> colors = context->get_colors(num_pixels * 3);
+        ColorStatistics stats = apply_color_map(cm, values, num_pixels, colors.data(), profiler);
+
+        if(!accept(stats, colors.data()))
+        {
+            context->recycle(std::move(colors));
+            return false;
+        }
+
+        if(settings.normalize)
+            normalize(stats, colors.data(), num_pixels);
+
+        // write the image(s) from the color values.
+        store_images(open_images(dim_x, dim_y, function_seed, color_seed, s == streamed_png), std::move(colors), dim_y,
+                     use_render_cache() ? render_cache_key(function_seed, color_seed) : "");
+
+        return true;
+    }
+
+    /**
+     * Renders an image whose values do not fit into the memory budget next to its colors. The values are evaluated
+     * and colored in bands of rows, the colors of the whole image are kept, so the statistics and the image are the
+     * same as in memory. The prescreening needs all values and is not used, it only rejects images early.
+     */
+    bool generate_values_in_bands(const RandomFunction& rf, const PolynomialColorMap& cm,
+                                  const uint32_t dim_x, const uint32_t dim_y,
+                                  const unsigned int function_seed, const unsigned int color_seed) const
+    {
+        const uint64_t num_pixels = static_cast<uint64_t>(dim_x) * dim_y;
+        const uint32_t band_rows = values_band_rows(dim_x, dim_y);
+        verbose(settings.verbose, "Evaluating in bands of " + std::to_string(band_rows) + " rows");
+
+        argument_type* values = context->get_values(static_cast<uint64_t>(band_rows) * dim_x);
+        Buffer<uint8_t> colors = context->get_colors(num_pixels * 3);
+
+        // sums, minima and maxima merge exactly
+        ColorStatistics stats;
+        for(uint32_t first_row = 0; first_row < dim_y; first_row += band_rows)
+        {
+            const uint32_t rows = std::min(band_rows, dim_y - first_row);
+            const uint64_t band_pixels = static_cast<uint64_t>(rows) * dim_x;
+
+            evaluate(rf, 0, first_row, dim_x, rows, 1, values);
+            stats.merge(apply_color_map(cm, values, band_pixels,
+                                        colors.data() + 3 * pos_to_index(0, first_row, dim_x, dim_y), profiler));
+        }
+        stats.compute_means();
+
+        if(!accept(stats, colors.data()))
+        {
+            context->recycle(std::move(colors));
+            return false;
+        }
+
+        if(settings.normalize)
+            normalize(stats, colors.data(), num_pixels);
+
+        store_images(open_images(dim_x, dim_y, function_seed, color_seed, true), std::move(colors), dim_y,
+                     use_render_cache() ? render_cache_key(function_seed, color_seed) : "");
+
+        return true;
+    }
+
+    // the preview pass of the banded rendering uses about this many pixels.
+    static constexpr uint64_t preview_pixels = 1u << 20;
+
+    /**
+     * An output file together with the time spent encoding it.
+     */
+    struct OutputImage
+    {
+        std::string file_name;
+        std::unique_ptr<ImageStream> stream;
+        double encode_ms = 0.0;
+
+        void write_rows(const uint8_t* colors, const uint32_t num_rows)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            stream->write_rows(colors, num_rows);
+            encode_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        void finish(const bool verbose_on)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            const uint64_t bytes = stream->finish();
+            encode_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            verbose(verbose_on, "Stored " + file_name + ": " + std::to_string(bytes) + " bytes, encoded in "
+                                + std::to_string(encode_ms) + " ms");
+        }
+    };
+
+    /**
+     * Renders images that do not fit into the memory budget. The rejection and normalization statistics are computed
+     * in a preview pass on a sub grid of the image first. Then the image is rendered in bands of rows that are
+     * streamed to the image file(s), so only one band needs to be in memory.
+     */
+    bool generate_banded(const RandomFunction& rf, const PolynomialColorMap& cm,
+                         const uint32_t dim_x, const uint32_t dim_y,
+                         const unsigned int function_seed, const unsigned int color_seed) const
+    {
+        ColorStatistics stats;
+        if(!preview(rf, cm, dim_x, dim_y, stats))
+            return false;
+
+        const uint32_t band_rows = this->band_rows(dim_x, dim_y);
+
+        verbose(settings.verbose, "Rendering in bands of " + std::to_string(band_rows) + " rows");
+
+        const uint64_t max_band_pixels = static_cast<uint64_t>(band_rows) * dim_x;
+        argument_type* values = context->get_values(max_band_pixels);
+        Buffer<uint8_t> colors = context->get_colors(max_band_pixels * 3);
+
+        auto images = open_images(dim_x, dim_y, function_seed, color_seed);
+
+        for(uint32_t first_row = 0; first_row < dim_y; first_row += band_rows)
+        {
+            const uint32_t rows = std::min(band_rows, dim_y - first_row);
+            const uint64_t band_pixels = static_cast<uint64_t>(rows) * dim_x;
+
+            evaluate(rf, 0, first_row, dim_x, rows, 1, values);
+            apply_color_map(cm, values, band_pixels, colors.data(), profiler);
+
+            if(settings.normalize)
+                normalize(stats, colors.data(), band_pixels, first_row == 0);
+
+            const Profiler::Scope write_time(profiler, Profiler::write);
+            for(auto& image : images)
+                image.write_rows(colors.data(), rows);
+        }
+
+        Profiler::Scope finish_time(profiler, Profiler::write);
+        for(auto& image : images)
+            image.finish(settings.verbose);
+        finish_time.stop();
+
+        context->recycle(std::move(colors));
+
+        if(use_render_cache())
+            render_cache->store(render_cache_key(function_seed, color_seed), get_output_names(function_seed, color_seed));
+
+        return true;
+    }
+
+    /**
+     * Renders the image by the worker processes. The colors are written into shared memory, so only the statistics
+     * of the tiles are sent back. These are merged exactly, the variances and the normalization are computed on the
+     * whole image like in generate(). The prescreening needs the values and is not used.
+     */
+    bool generate_distributed(const uint32_t dim_x, const uint32_t dim_y,
+                              const unsigned int function_seed, const unsigned int color_seed) const
+    {
+        const uint64_t num_pixels = static_cast<uint64_t>(dim_x) * dim_y;
+        SharedMemory colors(num_pixels * 3);
+
+        TileRequest request = {TileRequest::begin_image, function_seed, color_seed, dim_x, dim_y, 0, 0, 0, 0};
+        for(size_t w = 0; w < worker_pool->size(); w++)
+            WorkerPool::send(worker_pool->socket(w), &request, sizeof(request), colors.get_fd());
+
+        std::vector<TileRequest> tiles;
+        for(uint32_t y = 0; y < dim_y; y += worker_tile_size)
+            for(uint32_t x = 0; x < dim_x; x += worker_tile_size)
+                tiles.push_back({TileRequest::tile, function_seed, color_seed, dim_x, dim_y, x, y,
+                                 std::min(worker_tile_size, dim_x - x), std::min(worker_tile_size, dim_y - y)});
+
+        // every worker gets two tiles ahead, so it does not wait for the coordinator
+        size_t next = 0;
+        for(size_t k = 0; k < 2; k++)
+            for(size_t w = 0; w < worker_pool->size() && next < tiles.size(); w++)
+                WorkerPool::send(worker_pool->socket(w), &tiles[next++], sizeof(TileRequest));
+
+        ColorStatistics stats;
+        for(size_t done = 0; done < tiles.size(); done++)
+        {
+            const size_t w = worker_pool->wait_any();
+
+            ColorStatistics tile_stats;
+            if(!WorkerPool::receive(worker_pool->socket(w), &tile_stats, sizeof(tile_stats)))
+                throw std::runtime_error("A worker process stopped.");
+            stats.merge(tile_stats);
+
+            if(next < tiles.size())
+                WorkerPool::send(worker_pool->socket(w), &tiles[next++], sizeof(TileRequest));
+        }
+
+        request.type = TileRequest::end_image;
+        for(size_t w = 0; w < worker_pool->size(); w++)
+            WorkerPool::send(worker_pool->socket(w), &request, sizeof(request));
+
+        stats.compute_means();
+
+        if(!accept(stats, colors.data()))
+            return false;
+
+        if(settings.normalize)
+            normalize(stats, colors.data(), num_pixels);
+
+        auto images = open_images(dim_x, dim_y, function_seed, color_seed);
+        for(auto& image : images)
+        {
+            image.write_rows(colors.data(), dim_y);
+            image.finish(settings.verbose);
+        }
+
+        if(use_render_cache())
+            render_cache->store(render_cache_key(function_seed, color_seed), get_output_names(function_seed, color_seed));
+
+        return true;
+    }
+
+    /**
+     * Computes the statistics for rejecting and normalizing the image on a sub grid of at most about
+     * preview_pixels pixels. Smaller images are evaluated completely.
+     * @return true if the image should be stored.
+     */
+    bool preview(const RandomFunction& rf, const PolynomialColorMap& cm,
+                 const uint32_t dim_x, const uint32_t dim_y, ColorStatistics& stats) const
+    {
+        const uint64_t num_pixels = static_cast<uint64_t>(dim_x) * dim_y;
+        const auto stride = static_cast<uint32_t>(std::max(1.0, std::ceil(std::sqrt(
+            static_cast<double>(num_pixels) / preview_pixels))));
+        const uint32_t preview_x = (dim_x + stride - 1) / stride;
+        const uint32_t preview_y = (dim_y + stride - 1) / stride;
+        const uint64_t num_preview_pixels = static_cast<uint64_t>(preview_x) * preview_y;
+
+        verbose(settings.verbose, "Preview pass on every " + std::to_string(stride) + ". pixel ("
+                                  + std::to_string(preview_x) + " x " + std::to_string(preview_y) + ")");
+
+        std::vector<argument_type> values(num_preview_pixels);
+        evaluate(rf, 0, 0, preview_x, preview_y, stride, values.data());
+
+        std::vector<uint8_t> colors(num_preview_pixels * 3);
+        stats = apply_color_map(cm, values.data(), num_preview_pixels, colors.data(), profiler);
+
+        return accept(stats, colors.data());
+    }
+
+    /**
+     * Exports the image as a deep zoom tile pyramid. Every level is evaluated directly from the random function on a
+     * sub grid of the full resolution image, so no level is downsampled from another one. The tiles are rendered and
+     * written in parallel.
+     *
+     * dzi writes <name>.dzi and <name>_files/<level>/<column>_<row>.<ext> with levels down to 1 x 1 pixel.
+     * xyz writes <name>_tiles/<z>/<x>/<y>.<ext>, where z = 0 is the largest level that fits into one tile.
+     */
+    bool generate_tiles(const RandomFunction& rf, const PolynomialColorMap& cm,
+                        const uint32_t dim_x, const uint32_t dim_y,
+                        const unsigned int function_seed, const unsigned int color_seed) const
+    {
+        ColorStatistics stats;
+        if(!preview(rf, cm, dim_x, dim_y, stats))
+            return false;
+
+        const uint32_t tile_size = settings.tile_size;
+        const std::string base_name = get_base_name(function_seed, color_seed);
+        const std::string extension = "." + ImageWriter::extension(settings.format);
+        const std::string tile_directory = base_name + (settings.tiles == dzi ? "_files/" : "_tiles/");
+
+        // the full resolution is the max level, every level below halves the resolution.
+        unsigned int max_level = 0;
+        while((uint64_t(1) << max_level) < std::max(dim_x, dim_y))
+            max_level++;
+
+        const auto level_size = [max_level](const uint32_t dim, const unsigned int level)
+        {
+            const unsigned int scale = max_level - level;
+            return static_cast<uint32_t>((static_cast<uint64_t>(dim) + (uint64_t(1) << scale) - 1) >> scale);
+        };
+
+        unsigned int min_level = 0;
+        if(settings.tiles == xyz)
+            while(min_level < max_level && std::max(level_size(dim_x, min_level + 1), level_size(dim_y, min_level + 1)) <= tile_size)
+                min_level++;
+
+        struct Tile
+        {
+            unsigned int level;
+            uint32_t column, row;
+            std::string file_name;
+        };
+
+        std::vector<Tile> tiles;
+
+        make_directory(tile_directory);
+        for(unsigned int level = min_level; level <= max_level; level++)
+        {
+            const std::string level_directory = tile_directory + std::to_string(level - min_level) + "/";
+            make_directory(level_directory);
+
+            const uint32_t columns = (level_size(dim_x, level) + tile_size - 1) / tile_size;
+            const uint32_t rows = (level_size(dim_y, level) + tile_size - 1) / tile_size;
+
+            for(uint32_t column = 0; column < columns; column++)
+            {
+                if(settings.tiles == xyz)
+                    make_directory(level_directory + std::to_string(column) + "/");
+
+                for(uint32_t row = 0; row < rows; row++)
+                {
+                    const std::string file_name = settings.tiles == dzi
+                        ? level_directory + std::to_string(column) + "_" + std::to_string(row) + extension
+                        : level_directory + std::to_string(column) + "/" + std::to_string(row) + extension;
+                    tiles.push_back({level, column, row, file_name});
+                }
+            }
+        }
+
+        verbose(settings.verbose, "Rendering " + std::to_string(tiles.size()) + " tiles on "
+                                  + std::to_string(max_level - min_level + 1) + " levels");
+
+        // the tiles are written in parallel, so every tile uses a single threaded encoder.
+        PngEncoder::Options png_options;
+        png_options.level = static_cast<int>(settings.png_level);
+        png_options.filter = settings.png_filter;
+
+        std::string error;
+
+#pragma omp parallel for schedule(dynamic)
+        for(size_t t = 0; t < tiles.size(); t++)
+        {
+            const Tile& tile = tiles[t];
+            const uint64_t stride = uint64_t(1) << (max_level - tile.level);
+            const uint32_t width = std::min(tile_size, level_size(dim_x, tile.level) - tile.column * tile_size);
+            const uint32_t height = std::min(tile_size, level_size(dim_y, tile.level) - tile.row * tile_size);
+            const uint64_t num_pixels = static_cast<uint64_t>(width) * height;
+
+            std::vector<argument_type> values(num_pixels);
+            evaluate(rf, tile.column * tile_size * stride, tile.row * tile_size * stride, width, height,
+                     static_cast<uint32_t>(stride), values.data());
+
+            std::vector<uint8_t> colors(num_pixels * 3);
+            apply_color_map(cm, values.data(), num_pixels, colors.data(), profiler);
+
+            if(settings.normalize)
+                normalize(stats, colors.data(), num_pixels, false);
+
+            try
+            {
+                auto stream = ImageWriter::open(settings.format, tile.file_name, width, height, png_options, {{0, 1, 2}});
+                stream->write_rows(colors.data(), height);
+                stream->finish();
+            }
+            catch(const std::exception& e)
             {
-                const argument_type x = static_cast<argument_type>(x_px) * step_size + settings.x.min;
-                values[pos_to_index(x_px, y_px, dim_x, dim_y)] = rf.eval(x, y);
+#pragma omp critical
+                error = e.what();
             }
         }
 
-        std::vector<uint8_t> colors(num_pixels * 3);
+        if(!error.empty())
+            throw std::runtime_error(error);
+
+        if(settings.tiles == dzi)
+        {
+            std::ofstream descriptor(base_name + ".dzi");
+            descriptor << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                       << "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\" Format=\""
+                       << ImageWriter::extension(settings.format) << "\" Overlap=\"0\" TileSize=\"" << tile_size << "\">\n"
+                       << "  <Size Width=\"" << dim_x << "\" Height=\"" << dim_y << "\"/>\n"
+                       << "</Image>\n";
+            if(!descriptor.good())
+                throw std::runtime_error("Could not write " + base_name + ".dzi");
+        }
+
+        verbose(settings.verbose, "Stored tiles in " + tile_directory);
+
+        return true;
+    }
 
-        const auto normalize = settings.normalize;
+    static void make_directory(const std::string& path)
+    {
+#ifdef _WIN32
+        const int result = _mkdir(path.c_str());
+#else
+        const int result = mkdir(path.c_str(), 0755);
+#endif
+        if(result != 0 && errno != EEXIST)
+            throw std::runtime_error("Could not create the directory " + path);
+    }
+
+    /**
+     * Describes everything the values of the random function depend on. The floats are stored exactly.
+     */
+    std::string value_cache_key(const unsigned int function_seed, const uint32_t dim_x, const uint32_t dim_y) const
+    {
+        std::ostringstream key;
+        key << std::hexfloat
+            << "function seed " << function_seed << "\n"
+            << "function pool " << settings.unary_function_pool_size << " " << settings.binary_function_pool_size << "\n"
+            << "function depth " << settings.function_depth << "\n"
+            << "function params " << settings.function_param << "\n"
+            << "x " << settings.x << "\n"
+            << "y " << settings.y << "\n"
+            << "resolution " << settings.resolution << " " << dim_x << " " << dim_y << "\n";
+        return key.str();
+    }
+
+    // tiles and color variants are not cached
+    bool use_render_cache() const
+    {
+        return render_cache && settings.tiles == no_tiles && settings.color_variants == 1;
+    }
+
+    /**
+     * Describes everything the random function depends on, in one line. The floats are stored exactly.
+     */
+    std::string function_key(const unsigned int function_seed) const
+    {
+        std::ostringstream key;
+        key << std::hexfloat
+            << function_seed << " " << settings.unary_function_pool_size << " " << settings.binary_function_pool_size
+            << " " << settings.function_depth << " " << settings.function_param;
+        return key.str();
+    }
+
+    /**
+     * Describes everything the color map depends on, in one line. The floats are stored exactly.
+     */
+    std::string color_key(const unsigned int color_seed) const
+    {
+        std::ostringstream key;
+        key << std::hexfloat
+            << color_seed << " " << settings.color_poly_deg << " " << settings.color_poly_param << " "
+            << static_cast<unsigned int>(settings.pt);
+        return key.str();
+    }
 
-        // statistics
-        uint32_t acc_r = 0, acc_g = 0, acc_b = 0;
+    /**
+     * Describes everything the pixels and the file format of an image depend on, in one line. The floats are stored
+     * exactly.
+     */
+    std::string render_cache_key(const unsigned int function_seed, const unsigned int color_seed) const
+    {
+        std::ostringstream key;
+        key << std::hexfloat
+            << function_seed << " " << color_seed << " "
+            << settings.unary_function_pool_size << " " << settings.binary_function_pool_size << " "
+            << settings.function_depth << " " << settings.function_param << " "
+            << settings.color_poly_deg << " " << settings.color_poly_param << " "
+            << static_cast<unsigned int>(settings.pt) << " " << settings.x << " " << settings.y << " "
+            << settings.resolution << " " << settings.normalize << " " << settings.generate_all_color_permutations << " "
+            << ImageWriter::extension(settings.format);
+        return key.str();
+    }
+
+    /**
+     * Maps the values of the random function from the value cache. If they are not cached yet, they get evaluated
+     * directly into a new cache file.
+     */
+    std::unique_ptr<MappedValues> load_or_evaluate(const RandomFunction& rf, const unsigned int function_seed,
+                                                   const uint32_t dim_x, const uint32_t dim_y) const
+    {
+        const uint64_t num_pixels = static_cast<uint64_t>(dim_x) * dim_y;
+        const std::string key = value_cache_key(function_seed, dim_x, dim_y);
+        const std::string path = settings.value_cache + "/" + std::to_string(function_seed) + "."
+                                 + MappedValues::hash(key) + ".values";
+
+        auto mapping = MappedValues::load(path, key, num_pixels);
+        if(mapping)
+        {
+            verbose(settings.verbose, "Values loaded from " + path);
+            return mapping;
+        }
+
+        mapping = MappedValues::create(path, key, num_pixels);
+        evaluate(rf, 0, 0, dim_x, dim_y, 1, mapping->data());
+        mapping->commit();
+        verbose(settings.verbose, "Values stored in " + path);
+
+        return mapping;
+    }
+
+    uint64_t memory_budget_bytes() const
+    {
+        return static_cast<uint64_t>(settings.memory_budget) << 20;
+    }
+
+    bool parallel_png() const
+    {
+        return settings.format == ImageWriter::png && settings.png_threads > 1;
+    }
+
+    /**
+     * How an image is rendered, from the fastest to the one that needs the least memory. The first one whose
+     * estimated peak fits into the memory budget is used.
+     * in_memory: the values, the colors and the copies of the multi threaded png encoder of the whole image.
+     * streamed_png: the png files are encoded by one thread, which streams the rows and needs no copies.
+     * values_in_bands: the values are evaluated in bands of rows, only the colors of the whole image are kept.
+     * banded: the statistics are taken from a preview and every band of rows is written before the next one.
+     */
+    enum strategy : uint8_t {in_memory, streamed_png, values_in_bands, banded};
+
+    static const char* strategy_name(const strategy s)
+    {
+        static const char* names[] = {"in memory", "streamed png", "values in bands", "banded"};
+        return names[s];
+    }
+
+    strategy choose_strategy(const uint32_t dim_x, const uint32_t dim_y) const
+    {
+        if(settings.memory_budget == 0)
+            return in_memory;
+
+        for(const strategy s : {in_memory, streamed_png, values_in_bands})
+        {
+            // the value cache needs all values
+            if(s == values_in_bands && !settings.value_cache.empty())
+                continue;
+            if(estimate_peak_bytes(s, dim_x, dim_y) <= memory_budget_bytes())
+                return s;
+        }
+        return banded;
+    }
+
+    /**
+     * The estimated peak memory of the image buffers of a strategy.
+     */
+    uint64_t estimate_peak_bytes(const strategy s, const uint32_t dim_x, const uint32_t dim_y) const
+    {
+        const uint64_t num_pixels = static_cast<uint64_t>(dim_x) * dim_y;
+        // an image that waits for the background writer keeps its colors
+        const uint64_t pending_colors = background_writer ? 3 : 0;
+
+        switch(s)
+        {
+            case in_memory:
+            case streamed_png:
+                return num_pixels * (in_memory_bytes_per_pixel(s == in_memory && parallel_png()) + pending_colors);
+            case values_in_bands:
+                return num_pixels * (3 + pending_colors)
+                       + static_cast<uint64_t>(values_band_rows(dim_x, dim_y)) * dim_x * sizeof(argument_type);
+            default:
+                // the preview is freed before the first band
+                return std::max(std::min<uint64_t>(num_pixels, preview_pixels) * (sizeof(argument_type) + 3),
+                                banded_fixed_bytes(dim_x, dim_y)
+                                + static_cast<uint64_t>(band_rows(dim_x, dim_y)) * dim_x * banded_bytes_per_pixel());
+        }
+    }
+
+    // values, colors of every color variant and the filtered and compressed copies of the multi threaded png encoder.
+    uint64_t in_memory_bytes_per_pixel(const bool png_copies) const
+    {
+        return sizeof(argument_type) + 3 * settings.color_variants + (png_copies ? 6 : 0);
+    }
+
+    /**
+     * The rows of values evaluated at once by values_in_bands, what the budget leaves next to the colors, but at least
+     * enough to keep every thread busy.
+     */
+    uint32_t values_band_rows(const uint32_t dim_x, const uint32_t dim_y) const
+    {
+        const uint64_t colors = static_cast<uint64_t>(dim_x) * dim_y * (3 + (background_writer ? 3 : 0));
+        const uint64_t left = memory_budget_bytes() > colors ? memory_budget_bytes() - colors : 0;
+        const auto min_rows = static_cast<uint64_t>(4 * omp_get_max_threads());
+        return static_cast<uint32_t>(std::min<uint64_t>(
+            dim_y, std::max(min_rows, left / (static_cast<uint64_t>(dim_x) * sizeof(argument_type)))));
+    }
+
+    // the rows of a band of the banded rendering, what the budget leaves next to the fixed costs
+    uint32_t band_rows(const uint32_t dim_x, const uint32_t dim_y) const
+    {
+        const uint64_t fixed = banded_fixed_bytes(dim_x, dim_y);
+        const uint64_t left = memory_budget_bytes() > fixed ? memory_budget_bytes() - fixed : 0;
+        const uint64_t bytes_per_row = banded_bytes_per_pixel() * dim_x;
+        return static_cast<uint32_t>(std::min<uint64_t>(dim_y, std::max<uint64_t>(1, left / bytes_per_row)));
+    }
+
+    // the memory of the banded rendering that does not depend on the band size: the colors of an image that waits for
+    // the background writer
+    uint64_t banded_fixed_bytes(const uint32_t dim_x, const uint32_t dim_y) const
+    {
+        return background_writer ? static_cast<uint64_t>(dim_x) * dim_y * 3 : 0;
+    }
+
+    // every band is handed to all output images at once.
+    uint64_t banded_bytes_per_pixel() const
+    {
+        const uint64_t num_images = settings.generate_all_color_permutations ? 6 : 1;
+        return sizeof(argument_type) + 3 + (parallel_png() ? 6 * num_images : 0);
+    }
+
+    /**
+     * Evaluates the random function on a grid of pixels. The pixel (i, j) of the grid is the pixel
+     * (x_px + i * stride, y_px + j * stride) of the full image, so sub grids evaluate to exactly the same values.
+     * @param values Buffer for width * height values.
+     */
+    void evaluate(const RandomFunction& rf, const uint64_t x_px, const uint64_t y_px,
+                  const uint32_t width, const uint32_t height, const uint32_t stride, argument_type* values) const
+    {
+        const auto step_size = 1.f / static_cast<argument_type>(settings.resolution);
+        const Profiler::Scope time(profiler, Profiler::evaluate);
+
+#pragma omp parallel
+        {
+            const Profiler::ThreadScope busy(profiler, Profiler::evaluate);
+
+#pragma omp for schedule(static) nowait
+            for(uint32_t j = 0; j < height; j++)
+            {
+                const argument_type y = static_cast<argument_type>(y_px + static_cast<uint64_t>(j) * stride) * step_size
+                                        + settings.y.min;
+                if(row_evaluator)
+                {
+                    row_evaluator(y, x_px, stride, width, step_size, settings.x.min,
+                                  values + pos_to_index(0, j, width, height));
+                    continue;
+                }
+
+                for(uint32_t i = 0; i < width; i++)
+                {
+                    const argument_type x = static_cast<argument_type>(x_px + static_cast<uint64_t>(i) * stride)
+                                            * step_size + settings.x.min;
+                    values[pos_to_index(i, j, width, height)] = rf.eval(x, y);
+                }
+            }
+        }
+    }
+
+    /**
+     * Maps the values to colors and collects the statistics of the colors. A baked color map maps blocks of
+     * color_block pixels, the statistics are collected from the colors of the block afterwards.
+     * @param colors Buffer for 3 * num_pixels color values.
+     */
+    ColorStatistics apply_color_map(const PolynomialColorMap& cm, const argument_type* values,
+                                    const uint64_t num_pixels, uint8_t* colors, Profiler* profiler = nullptr) const
+    {
+        uint64_t acc_r = 0, acc_g = 0, acc_b = 0;
         uint8_t  min_r = 255, min_g = 255, min_b = 255;
         uint8_t  max_r = 0, max_g = 0, max_b = 0;
 
-        uint32_t white = 0,
+        uint64_t white = 0,
                  black = 0;
 
-#pragma omp parallel for reduction(+:acc_r,acc_g,acc_b,white,black) reduction(min:min_r,min_g,min_b) reduction(max:max_r,max_g,max_b)
-        for(uint32_t y_px = 0; y_px < dim_y; y_px++)
+        const Profiler::Scope time(profiler, Profiler::color);
+
+#pragma omp parallel reduction(+:acc_r,acc_g,acc_b,white,black) reduction(min:min_r,min_g,min_b) reduction(max:max_r,max_g,max_b)
+        {
+            const Profiler::ThreadScope busy(profiler, Profiler::color);
+
+            if(color_evaluator)
+            {
+#pragma omp for schedule(static) nowait
+                for(uint64_t block = 0; block < num_pixels; block += color_block)
+                {
+                    const uint64_t end = std::min(num_pixels, block + color_block);
+                    color_evaluator(values + block, end - block, colors + 3 * block);
+
+                    for(uint64_t i = block; i < end; i++)
+                    {
+                        const uint8_t r = colors[3 * i];
+                        const uint8_t g = colors[3 * i + 1];
+                        const uint8_t b = colors[3 * i + 2];
+
+                        white += close_to_white(r, g, b);
+                        black += close_to_black(r, g, b);
+                        acc_r += r;
+                        acc_g += g;
+                        acc_b += b;
+                        min_r = std::min(min_r, r);
+                        min_g = std::min(min_g, g);
+                        min_b = std::min(min_b, b);
+                        max_r = std::max(max_r, r);
+                        max_g = std::max(max_g, g);
+                        max_b = std::max(max_b, b);
+                    }
+                }
+            }
+            else
+            {
+#pragma omp for schedule(static) nowait
+                for(uint64_t i = 0; i < num_pixels; i++)
+                {
+                    uint8_t r, g, b;
+                    cm.get_color(values[i], r, g, b);
+
+                    colors[3 * i] = r;
+                    colors[3 * i + 1] = g;
+                    colors[3 * i + 2] = b;
+
+                    // prepare statistics
+                    white += close_to_white(r, g, b);
+                    black += close_to_black(r, g, b);
+                    acc_r += r;
+                    acc_g += g;
+                    acc_b += b;
+                    min_r = std::min(min_r, r);
+                    min_g = std::min(min_g, g);
+                    min_b = std::min(min_b, b);
+                    max_r = std::max(max_r, r);
+                    max_g = std::max(max_g, g);
+                    max_b = std::max(max_b, b);
+                }
+            }
+        }
+
+        ColorStatistics stats;
+        stats.num_pixels = num_pixels;
+        stats.acc_r = acc_r; stats.acc_g = acc_g; stats.acc_b = acc_b;
+        stats.min_r = min_r; stats.min_g = min_g; stats.min_b = min_b;
+        stats.max_r = max_r; stats.max_g = max_g; stats.max_b = max_b;
+        stats.white = white;
+        stats.black = black;
+        stats.compute_means();
+
+        return stats;
+    }
+
+    /**
+     * Applies color_variants color maps to the values of one random function. The color map of color_seed is the
+     * first variant, the others use the following seeds if the color seed is fixed or comes from a seed stream and
+     * random seeds else. The values are processed in small tiles and every tile is colored by all color maps while it
+     * is still in the cache. Every variant is rejected, normalized and stored on its own, exactly like a single image
+     * with its color seed.
+     * @return true if at least one variant got stored.
+     */
+    bool generate_color_variants(const PolynomialColorMap& cm, const argument_type* values,
+                                 const ValueHistogram* histogram, const uint32_t dim_x, const uint32_t dim_y,
+                                 const unsigned int function_seed, const unsigned int color_seed) const
+    {
+        const uint64_t num_pixels = static_cast<uint64_t>(dim_x) * dim_y;
+
+        std::random_device rd;
+        std::vector<unsigned int> color_seeds;
+        std::vector<PolynomialColorMap> color_maps;
+
+        for(unsigned int k = 0, seed = color_seed; k < settings.color_variants; k++)
+        {
+            if(k > 0)
+                seed = settings.color_map_seed || seed_stream ? seed + 1 : rd();
+            if(seed == 0)   // zero means "not set" for seeds
+                seed = 1;
+
+            const PolynomialColorMap variant = draw_color_map(seed);
+
+            // only variants that pass the prescreening get colored
+            if(histogram && !prescreen(*histogram, variant))
+                continue;
+
+            color_seeds.push_back(seed);
+            color_maps.push_back(variant);
+        }
+
+        if(color_maps.empty())
+            return false;
+
+        std::vector<Buffer<uint8_t>> colors;
+        for(size_t k = 0; k < color_maps.size(); k++)
+            colors.push_back(context->get_colors(num_pixels * 3));
+        Profiler::Scope color_time(profiler, Profiler::color);
+        std::vector<ColorStatistics> stats = apply_color_maps(color_maps, values, num_pixels, colors);
+        color_time.stop();
+
+        bool stored = false;
+        for(size_t k = 0; k < color_maps.size(); k++)
+        {
+            verbose(settings.verbose, "Color variant with seed " + std::to_string(color_seeds[k]));
+
+            if(!accept(stats[k], colors[k].data()))
+            {
+                context->recycle(std::move(colors[k]));
+                continue;
+            }
+
+            if(settings.normalize)
+                normalize(stats[k], colors[k].data(), num_pixels);
+
+            // the buffer is handed over, so it is recycled once the images are stored
+            store_images(open_images(dim_x, dim_y, function_seed, color_seeds[k]), std::move(colors[k]), dim_y);
+            stored = true;
+        }
+
+        return stored;
+    }
+
+    /**
+     * Rejects the color maps that accept() would certainly reject, without coloring the whole image. The colors of the
+     * pixels of every bin of the histogram are bounded by PolynomialColorMap::get_color_bounds() of the smallest and
+     * the largest value of the bin. This gives upper bounds of the ranges and the variances and lower bounds of the
+     * white and black pixels, which are checked against the criteria of accept(). Every other color map is left to
+     * accept().
+     * @return false if accept() would reject the image.
+     */
+    bool prescreen(const ValueHistogram& histogram, const PolynomialColorMap& cm) const
+    {
+        const Profiler::Scope time(profiler, Profiler::prescreen);
+        const auto& bins = histogram.get_bins();
+
+        uint64_t num_pixels = 0;
+        size_t largest = 0;
+        for(size_t b = 0; b < bins.size(); b++)
+        {
+            num_pixels += bins[b].count;
+            if(bins[b].count > bins[largest].count)
+                largest = b;
+        }
+
+        // the variance is at most the mean squared distance to any color, a color of the largest bin keeps it small
+        std::array<uint8_t, 3> lo, hi;
+        cm.get_color_bounds(bins[largest].min, bins[largest].max, lo, hi);
+        const std::array<uint8_t, 3> center = lo;
+
+        uint64_t white = 0, black = 0;
+        std::array<uint8_t, 3> min_c = {{255, 255, 255}}, max_c = {{0, 0, 0}};
+        std::array<uint64_t, 3> squares = {{0, 0, 0}};
+
+        for(const auto& bin : bins)
+        {
+            if(bin.count == 0)
+                continue;
+
+            cm.get_color_bounds(bin.min, bin.max, lo, hi);
+            white += bin.count * close_to_white(lo[0], lo[1], lo[2]);
+            black += bin.count * close_to_black(hi[0], hi[1], hi[2]);
+            for(size_t i = 0; i < 3; i++)
+            {
+                min_c[i] = std::min(min_c[i], lo[i]);
+                max_c[i] = std::max(max_c[i], hi[i]);
+                const auto distance = static_cast<uint64_t>(std::max(std::abs(lo[i] - center[i]),
+                                                                     std::abs(hi[i] - center[i])));
+                squares[i] += bin.count * distance * distance;
+            }
+        }
+
+        bool small_range = true, low_variance = true;
+        for(size_t i = 0; i < 3; i++)
         {
-            for(uint32_t x_px = 0; x_px < dim_x; x_px++)
+            small_range &= max_c[i] - min_c[i] < single_color_range;
+            // the margin covers the rounding errors of the variances of accept()
+            low_variance &= squares[i] < num_pixels * single_color_variance * 0.99;
+        }
+
+        if(small_range || low_variance || white > num_pixels * single_color_share
+           || black > num_pixels * single_color_share)
+        {
+            verbose(settings.verbose, "Prescreening: single color image -> trying again");
+            return false;
+        }
+
+        return true;
+    }
+
+    /**
+     * Applies several color maps to the same values. Every tile of values is colored by all color maps before the
+     * next tile is loaded.
+     * @param colors One buffer for 3 * num_pixels color values per color map.
+     */
+    static std::vector<ColorStatistics> apply_color_maps(const std::vector<PolynomialColorMap>& color_maps,
+                                                         const argument_type* values, const uint64_t num_pixels,
+                                                         std::vector<Buffer<uint8_t>>& colors)
+    {
+        // 16 KiB of values
+        constexpr uint64_t tile_pixels = 4096;
+        const uint64_t num_tiles = (num_pixels + tile_pixels - 1) / tile_pixels;
+
+        std::vector<ColorStatistics> stats(color_maps.size());
+
+#pragma omp parallel
+        {
+            std::vector<ColorStatistics> local_stats(color_maps.size());
+
+#pragma omp for schedule(static)
+            for(uint64_t tile = 0; tile < num_tiles; tile++)
             {
-                const auto i = pos_to_index(x_px, y_px, dim_x, dim_y);
-
-                uint8_t r, g, b;
-                cm.get_color(values[i], r, g, b);
-
-                colors[3 * i] = r;
-                colors[3 * i + 1] = g;
-                colors[3 * i + 2] = b;
-
-                // prepare statistics
-                white += close_to_white(r, g, b);
-                black += close_to_black(r, g, b);
-                acc_r += r;
-                acc_g += g;
-                acc_b += b;
-                min_r = std::min(min_r, r);
-                min_g = std::min(min_g, g);
-                min_b = std::min(min_b, b);
-                max_r = std::max(max_r, r);
-                max_g = std::max(max_g, g);
-                max_b = std::max(max_b, b);
+                const uint64_t first = tile * tile_pixels;
+                const uint64_t last = std::min(num_pixels, first + tile_pixels);
+
+                for(size_t k = 0; k < color_maps.size(); k++)
+                {
+                    uint8_t* c = colors[k].data();
+                    for(uint64_t i = first; i < last; i++)
+                    {
+                        uint8_t r, g, b;
+                        color_maps[k].get_color(values[i], r, g, b);
+
+                        c[3 * i] = r;
+                        c[3 * i + 1] = g;
+                        c[3 * i + 2] = b;
+
+                        local_stats[k].add(r, g, b);
+                    }
+                }
             }
+
+#pragma omp critical
+            for(size_t k = 0; k < color_maps.size(); k++)
+                stats[k].merge(local_stats[k]);
         }
 
-        verbose(settings.verbose, "white pixels: " + std::to_string(static_cast<double>(white) / num_pixels));
-        verbose(settings.verbose, "black pixels: " + std::to_string(static_cast<double>(black) / num_pixels));
+        for(auto& s : stats)
+        {
+            s.num_pixels = num_pixels;
+            s.compute_means();
+        }
 
-        double mean_r = static_cast<double>(acc_r) / num_pixels;
-        double mean_g = static_cast<double>(acc_g) / num_pixels;
-        double mean_b = static_cast<double>(acc_b) / num_pixels;
+        return stats;
+    }
+
+    /**
+     * Rejects single color images. If the image is accepted the variances are added to the statistics.
+     * @param colors The colors the statistics were collected from.
+     * @return true if the image should be stored.
+     */
+    bool accept(ColorStatistics& stats, const uint8_t* colors) const
+    {
+        const uint64_t num_pixels = stats.num_pixels;
+        const Profiler::Scope time(profiler, Profiler::statistics);
+
+        verbose(settings.verbose, "white pixels: " + std::to_string(static_cast<double>(stats.white) / num_pixels));
+        verbose(settings.verbose, "black pixels: " + std::to_string(static_cast<double>(stats.black) / num_pixels));
 
         // find single color images
-        if((max_r - min_r < 5 && max_g - min_g < 5 && max_b - min_b < 5)
-            || white > num_pixels * 0.85 || black > num_pixels * 0.85)
+        if((stats.max_r - stats.min_r < single_color_range && stats.max_g - stats.min_g < single_color_range
+            && stats.max_b - stats.min_b < single_color_range)
+            || stats.white > num_pixels * single_color_share || stats.black > num_pixels * single_color_share)
         {
             verbose(settings.verbose, "Single color image -> trying again");
             return false;
         }
 
-        double var_r, var_g, var_b;
-
-        std::tie(var_r, var_g, var_b) = get_color_variances(colors, mean_r, mean_g, mean_b);
+        std::tie(stats.var_r, stats.var_g, stats.var_b) = get_color_variances(colors, num_pixels,
+                                                                              stats.mean_r, stats.mean_g, stats.mean_b);
 
-        if(var_r < 0.01 && var_g < 0.01 && var_b < 0.01)
+        if(stats.var_r < single_color_variance && stats.var_g < single_color_variance
+           && stats.var_b < single_color_variance)
         {
             verbose(settings.verbose, "Single color image -> trying again");
             return false;
         }
 
-        if(normalize)
+        return true;
+    }
+
+    /**
+     * Normalizes the color transitions using the statistics of the whole image.
+     * @param print Shows the statistics in verbose mode.
+     */
+    void normalize(const ColorStatistics& stats, uint8_t* colors, const uint64_t num_pixels, const bool print = true) const
+    {
+        verbose(settings.verbose && print, "Normalizing:\n"
+            "min:  " + std::to_string(stats.min_r) + ", " + std::to_string(stats.min_g) + ", " + std::to_string(stats.min_b) + "\n" +
+            "max:  " + std::to_string(stats.max_r) + ", " + std::to_string(stats.max_g) + ", " + std::to_string(stats.max_b) + "\n" +
+            "mean: " + std::to_string(stats.mean_r) + ", " + std::to_string(stats.mean_g) + ", " + std::to_string(stats.mean_b) + "\n" +
+            "var:  " + std::to_string(stats.var_r) + ", " + std::to_string(stats.var_g) + ", " + std::to_string(stats.var_b));
+
+        const double mean_r = stats.mean_r, mean_g = stats.mean_g, mean_b = stats.mean_b;
+        const double var_r = stats.var_r, var_g = stats.var_g, var_b = stats.var_b;
+
+        const Profiler::Scope time(profiler, Profiler::normalize);
+
+#pragma omp parallel
         {
-            verbose(settings.verbose, "Normalizing:\n"
-                "min:  " + std::to_string(min_r) + ", " + std::to_string(min_g) + ", " + std::to_string(min_b) + "\n" +
-                "max:  " + std::to_string(max_r) + ", " + std::to_string(max_g) + ", " + std::to_string(max_b) + "\n" +
-                "mean: " + std::to_string(mean_r) + ", " + std::to_string(mean_g) + ", " + std::to_string(mean_b) + "\n" +
-                "var:  " + std::to_string(var_r) + ", " + std::to_string(var_g) + ", " + std::to_string(var_b));
+            const Profiler::ThreadScope busy(profiler, Profiler::normalize);
 
-#pragma omp parallel for
-            for (size_t i = 0; i < num_pixels; i++)
+#pragma omp for schedule(static) nowait
+            for (uint64_t i = 0; i < num_pixels; i++)
             {
                 if(var_r < 0.001)
                     colors[i * 3 + 0] = static_cast<uint8_t>((static_cast<double>(colors[i * 3 + 0]) - mean_r) / (var_r / 3));
@@ -371,68 +1796,83 @@ public:
                     colors[i * 3 + 2] = static_cast<uint8_t>((static_cast<double>(colors[i * 3 + 2]) - mean_b) / (var_b / 3));
             }
         }
-
-        // calculate the image from the color values.
-        if(settings.generate_all_color_permutations)
-            store_image_color_permutaions(dim_x, dim_y, function_seed, color_seed, colors);
-        else
-            store_image(dim_x, dim_y, function_seed, color_seed, colors);
-
-        return true;
     }
 
-private:
-    void store_image(const uint32_t dim_x, const uint32_t dim_y,
-                     const unsigned int function_seed, const unsigned int color_seed,
-                     const std::vector<uint8_t>& colors) const
+    /**
+     * Opens the output file(s) of an image. These are either one file or six files with all color permutations.
+     * @param serial_png Encodes png files by one thread, which streams the rows and needs no copies of the colors.
+     */
+    std::vector<OutputImage> open_images(const uint32_t dim_x, const uint32_t dim_y,
+                                         const unsigned int function_seed, const unsigned int color_seed,
+                                         const bool serial_png = false) const
     {
-        png::image<png::rgb_pixel> image(dim_x, dim_y);
+        static const std::array<std::array<uint8_t, 3>, 6> permutations = {{
+            {{0, 1, 2}}, {{0, 2, 1}}, {{1, 0, 2}}, {{1, 2, 0}}, {{2, 1, 0}}, {{2, 0, 1}}
+        }};
+
+        const Profiler::Scope time(profiler, Profiler::write);
+
+        PngEncoder::Options png_options;
+        png_options.threads = serial_png ? 1 : settings.png_threads;
+        png_options.level = static_cast<int>(settings.png_level);
+        png_options.filter = settings.png_filter;
 
-#pragma omp parallel for
-        for(png::uint_32 y_px = 0; y_px < image.get_height(); y_px++)
+        const std::vector<std::string> names = get_output_names(function_seed, color_seed);
+        std::vector<OutputImage> images;
+
+        for(size_t i = 0; i < names.size(); i++)
         {
-            for(png::uint_32 x_px = 0; x_px < image.get_width(); x_px++)
-            {
-                const auto i = 3 * pos_to_index(static_cast<uint32_t>(x_px), static_cast<uint32_t>(y_px), dim_x, dim_y);
-                image[y_px][x_px] = png::rgb_pixel(colors[i], colors[i + 1], colors[i + 2]);
-            }
+            images.push_back({names[i], nullptr});
+            images.back().stream = ImageWriter::open(settings.format, images.back().file_name, dim_x, dim_y,
+                                                     png_options, permutations[i]);
         }
 
-        image.write(settings.directory + settings.get_file_name(function_seed, color_seed) + ".png");
+        return images;
     }
 
-    void store_image_color_permutaions(const uint32_t dim_x, const uint32_t dim_y,
-                                       const unsigned int function_seed, const unsigned int color_seed,
-                                       const std::vector<uint8_t>& colors) const
+    /**
+     * Writes the colors into the opened images, on the background writer if there is one.
+     * @param cache_key The images are added to the render cache with this key once they are stored. Empty adds nothing.
+     */
+    void store_images(std::vector<OutputImage> images, Buffer<uint8_t> colors, const uint32_t dim_y,
+                      const std::string& cache_key = "") const
     {
-        png::image<png::rgb_pixel> image1(dim_x, dim_y);
-        png::image<png::rgb_pixel> image2(dim_x, dim_y);
-        png::image<png::rgb_pixel> image3(dim_x, dim_y);
-        png::image<png::rgb_pixel> image4(dim_x, dim_y);
-        png::image<png::rgb_pixel> image5(dim_x, dim_y);
-        png::image<png::rgb_pixel> image6(dim_x, dim_y);
+        // with a background writer only the wait for a free slot is measured
+        const Profiler::Scope time(profiler, Profiler::write);
 
-#pragma omp parallel for
-        for(png::uint_32 y_px = 0; y_px < image1.get_height(); y_px++)
+        // std::function needs a copyable task, so the images and colors are shared
+        auto image_data = std::make_shared<std::pair<std::vector<OutputImage>, Buffer<uint8_t>>>(
+            std::move(images), std::move(colors));
+        const bool verbose_on = settings.verbose;
+
+        const auto cache = cache_key.empty() ? nullptr : render_cache;
+        const auto buffers = context;
+        Tracer* tracer = profiler ? profiler->get_tracer() : nullptr;
+
+        auto store = [image_data, dim_y, verbose_on, cache, cache_key, buffers, tracer]()
         {
-            for(png::uint_32 x_px = 0; x_px < image1.get_width(); x_px++)
+            std::vector<std::string> names;
+            for(auto& image : image_data->first)
             {
-                const auto i = 3 * pos_to_index(static_cast<uint32_t>(x_px), static_cast<uint32_t>(y_px), dim_x, dim_y);
-                image1[y_px][x_px] = png::rgb_pixel(colors[i], colors[i + 1], colors[i + 2]);
-                image2[y_px][x_px] = png::rgb_pixel(colors[i], colors[i + 2], colors[i + 1]);
-                image3[y_px][x_px] = png::rgb_pixel(colors[i + 1], colors[i + 0], colors[i + 2]);
-                image4[y_px][x_px] = png::rgb_pixel(colors[i + 1], colors[i + 2], colors[i + 0]);
-                image5[y_px][x_px] = png::rgb_pixel(colors[i + 2], colors[i + 1], colors[i + 0]);
-                image6[y_px][x_px] = png::rgb_pixel(colors[i + 2], colors[i + 0], colors[i + 1]);
+                const auto start = Tracer::clock::now();
+                image.write_rows(image_data->second.data(), dim_y);
+                image.finish(verbose_on);
+                names.push_back(image.file_name);
+
+                if(tracer)
+                    tracer->record("write file", start, Tracer::clock::now(), image.file_name);
             }
-        }
 
-        image1.write(settings.directory + settings.get_file_name(function_seed, color_seed) + ".1.png");
-        image2.write(settings.directory + settings.get_file_name(function_seed, color_seed) + ".2.png");
-        image3.write(settings.directory + settings.get_file_name(function_seed, color_seed) + ".3.png");
-        image4.write(settings.directory + settings.get_file_name(function_seed, color_seed) + ".4.png");
-        image5.write(settings.directory + settings.get_file_name(function_seed, color_seed) + ".5.png");
-        image6.write(settings.directory + settings.get_file_name(function_seed, color_seed) + ".6.png");
+            buffers->recycle(std::move(image_data->second));
+
+            if(cache)
+                cache->store(cache_key, names);
+        };
+
+        if(background_writer)
+            background_writer->submit(store);
+        else
+            store();
     }
 };
 
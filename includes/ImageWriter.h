@@ -0,0 +1,426 @@
+#ifndef GENERATIVEART_IMAGE_WRITER_H
+#define GENERATIVEART_IMAGE_WRITER_H
+
+#include <png.hpp>
+
+#include "PngEncoder.h"
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+/**
+ * Image file that is written row by row. The rows can be handed over in bands, so images that do not fit into the
+ * memory can be streamed to the disk.
+ *
+ * All streams take interleaved rgb values and a channel order, so color permutations can be written without copying
+ * the image.
+ *
+ * The image is written to <file name>.tmp.<pid> and renamed to the file name by finish(). An existing file, which may be
+ * a hard link into the render cache, is replaced instead of overwritten, and a file with the name of the image is
+ * always complete, even if the process gets killed while writing.
+ */
+class ImageStream
+{
+protected:
+    const std::string file_name;
+    const std::string temporary_name;
+    const uint32_t width;
+    const uint32_t height;
+    const size_t row_bytes;
+    const std::array<uint8_t, 3> channel_order;
+    const bool identity;
+
+private:
+    bool renamed = false;
+
+public:
+    ImageStream(const std::string& file_name, const uint32_t width, const uint32_t height,
+                const std::array<uint8_t, 3>& channel_order)
+        : file_name(file_name),
+          temporary_name(file_name + ".tmp." + std::to_string(getpid())),
+          width(width),
+          height(height),
+          row_bytes(3 * static_cast<size_t>(width)),
+          channel_order(channel_order),
+          identity(channel_order[0] == 0 && channel_order[1] == 1 && channel_order[2] == 2)
+    {}
+
+    // the files of the derived streams are closed before, so an unfinished image can be removed
+    virtual ~ImageStream()
+    {
+        if(!renamed)
+            std::remove(temporary_name.c_str());
+    }
+
+    /**
+     * Writes the next rows of the image.
+     * @param rgb num_rows rows of interleaved rgb values.
+     */
+    virtual void write_rows(const uint8_t* rgb, uint32_t num_rows) = 0;
+
+    /**
+     * Completes the file. All rows must be written before.
+     * @return The size of the file in bytes.
+     */
+    virtual uint64_t finish() = 0;
+
+protected:
+    void permute_row(const uint8_t* src, uint8_t* dst) const
+    {
+        for(size_t i = 0; i < row_bytes; i += 3)
+        {
+            dst[i] = src[i + channel_order[0]];
+            dst[i + 1] = src[i + channel_order[1]];
+            dst[i + 2] = src[i + channel_order[2]];
+        }
+    }
+
+    std::ofstream open() const
+    {
+        std::ofstream file(temporary_name, std::ios::binary);
+        if(!file.is_open())
+            throw std::runtime_error("Could not open " + temporary_name + " for writing.");
+        return file;
+    }
+
+    /**
+     * Moves the written file to the file name. Called by finish() after the file is closed.
+     */
+    void rename()
+    {
+        if(std::rename(temporary_name.c_str(), file_name.c_str()) != 0)
+            throw std::runtime_error("Could not rename " + temporary_name + " to " + file_name + ".");
+        renamed = true;
+    }
+
+    static void write(std::ofstream& file, const uint8_t* data, const size_t length)
+    {
+        file.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(length));
+        if(!file.good())
+            throw std::runtime_error("Writing the image failed.");
+    }
+};
+
+/**
+ * Png file written by libpng through png++.
+ */
+class LibpngStream : public ImageStream
+{
+    std::ofstream file;
+    png::writer<std::ofstream> writer;
+    std::vector<png::byte> row;
+
+public:
+    LibpngStream(const std::string& file_name, const uint32_t width, const uint32_t height,
+                 const std::array<uint8_t, 3>& channel_order, const int level, const PngEncoder::filter_type filter)
+        : ImageStream(file_name, width, height, channel_order),
+          file(open()),
+          writer(file),
+          row(row_bytes)
+    {
+        png::image_info info = png::make_image_info<png::rgb_pixel>();
+        info.set_width(width);
+        info.set_height(height);
+        writer.set_image_info(info);
+        writer.set_compression_level(level);
+        writer.set_filter(libpng_filter(filter));
+        writer.write_info();
+    }
+
+    void write_rows(const uint8_t* rgb, const uint32_t num_rows) override
+    {
+        for(uint32_t y = 0; y < num_rows; y++)
+        {
+            const uint8_t* src = rgb + y * row_bytes;
+            if(identity)
+                std::copy(src, src + row_bytes, row.begin());
+            else
+                permute_row(src, row.data());
+            writer.write_row(row.data());
+        }
+    }
+
+    uint64_t finish() override
+    {
+        writer.write_end_info();
+        file.flush();
+        const auto bytes = static_cast<uint64_t>(file.tellp());
+        file.close();
+        rename();
+        return bytes;
+    }
+
+    static int libpng_filter(const PngEncoder::filter_type filter)
+    {
+        switch(filter)
+        {
+            case PngEncoder::none:    return PNG_FILTER_NONE;
+            case PngEncoder::sub:     return PNG_FILTER_SUB;
+            case PngEncoder::up:      return PNG_FILTER_UP;
+            case PngEncoder::average: return PNG_FILTER_AVG;
+            case PngEncoder::paeth:   return PNG_FILTER_PAETH;
+            case PngEncoder::adaptive:
+            default:                  return PNG_ALL_FILTERS;
+        }
+    }
+};
+
+/**
+ * Png file written by the multi threaded encoder.
+ */
+class ParallelPngStream : public ImageStream
+{
+    PngEncoder encoder;
+
+public:
+    ParallelPngStream(const std::string& file_name, const uint32_t width, const uint32_t height,
+                      const std::array<uint8_t, 3>& channel_order, const PngEncoder::Options& options)
+        : ImageStream(file_name, width, height, channel_order),
+          encoder(temporary_name, width, height, options, channel_order)
+    {}
+
+    void write_rows(const uint8_t* rgb, const uint32_t num_rows) override
+    {
+        encoder.write_rows(rgb, num_rows);
+    }
+
+    uint64_t finish() override
+    {
+        encoder.finish();
+        rename();
+        return encoder.bytes_written();
+    }
+};
+
+/**
+ * Binary portable pixmap (P6) or portable arbitrary map (P7) with the tuple type RGB. Both are a header followed by
+ * the raw pixels.
+ */
+class NetpbmStream : public ImageStream
+{
+    std::ofstream file;
+    uint64_t bytes = 0;
+    std::vector<uint8_t> row;
+
+public:
+    NetpbmStream(const std::string& file_name, const uint32_t width, const uint32_t height,
+                 const std::array<uint8_t, 3>& channel_order, const bool pam)
+        : ImageStream(file_name, width, height, channel_order),
+          file(open())
+    {
+        const std::string header = pam
+            ? "P7\nWIDTH " + std::to_string(width) + "\nHEIGHT " + std::to_string(height)
+              + "\nDEPTH 3\nMAXVAL 255\nTUPLTYPE RGB\nENDHDR\n"
+            : "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+        write(file, reinterpret_cast<const uint8_t*>(header.data()), header.size());
+        bytes = header.size();
+    }
+
+    void write_rows(const uint8_t* rgb, const uint32_t num_rows) override
+    {
+        if(identity)
+        {
+            write(file, rgb, row_bytes * num_rows);
+        }
+        else
+        {
+            row.resize(row_bytes);
+            for(uint32_t y = 0; y < num_rows; y++)
+            {
+                permute_row(rgb + y * row_bytes, row.data());
+                write(file, row.data(), row.size());
+            }
+        }
+        bytes += row_bytes * num_rows;
+    }
+
+    uint64_t finish() override
+    {
+        file.close();
+        if(file.fail())
+            throw std::runtime_error("Writing the image failed.");
+        rename();
+        return bytes;
+    }
+};
+
+/**
+ * The "Quite OK Image Format" (https://qoiformat.org), a lossless format that encodes about as fast as a copy.
+ */
+class QoiStream : public ImageStream
+{
+    std::ofstream file;
+    uint64_t bytes = 0;
+
+    // the images have no alpha channel, so alpha is always 255. The index keeps it anyway, because it starts with
+    // (0, 0, 0, 0) like the index of the decoder, which must not match a black pixel.
+    std::array<std::array<uint8_t, 4>, 64> index = {};
+    std::array<uint8_t, 4> prev = {{0, 0, 0, 255}};
+    uint8_t run = 0;
+
+    std::vector<uint8_t> out;
+
+public:
+    QoiStream(const std::string& file_name, const uint32_t width, const uint32_t height,
+              const std::array<uint8_t, 3>& channel_order)
+        : ImageStream(file_name, width, height, channel_order),
+          file(open())
+    {
+        const uint8_t header[14] = {
+            'q', 'o', 'i', 'f',
+            static_cast<uint8_t>(width >> 24), static_cast<uint8_t>(width >> 16),
+            static_cast<uint8_t>(width >> 8), static_cast<uint8_t>(width),
+            static_cast<uint8_t>(height >> 24), static_cast<uint8_t>(height >> 16),
+            static_cast<uint8_t>(height >> 8), static_cast<uint8_t>(height),
+            3,  // channels
+            0   // sRGB with linear alpha
+        };
+        flush(header, sizeof(header));
+    }
+
+    void write_rows(const uint8_t* rgb, const uint32_t num_rows) override
+    {
+        out.clear();
+        out.reserve(static_cast<size_t>(width) * num_rows);
+
+        const uint64_t num_pixels = static_cast<uint64_t>(width) * num_rows;
+        for(uint64_t i = 0; i < num_pixels; i++)
+        {
+            const uint8_t* src = rgb + 3 * i;
+            const std::array<uint8_t, 4> px = {{src[channel_order[0]], src[channel_order[1]], src[channel_order[2]],
+                                                255}};
+
+            if(px == prev)
+            {
+                run++;
+                if(run == 62)
+                    emit_run();
+                continue;
+            }
+
+            emit_run();
+
+            const uint8_t hash = static_cast<uint8_t>((px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64);
+            if(index[hash] == px)
+            {
+                out.push_back(hash);    // QOI_OP_INDEX
+            }
+            else
+            {
+                index[hash] = px;
+
+                const int8_t vr = static_cast<int8_t>(px[0] - prev[0]);
+                const int8_t vg = static_cast<int8_t>(px[1] - prev[1]);
+                const int8_t vb = static_cast<int8_t>(px[2] - prev[2]);
+                const int vg_r = vr - vg;
+                const int vg_b = vb - vg;
+
+                if(vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2)
+                {
+                    out.push_back(static_cast<uint8_t>(0x40 | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2)));  // QOI_OP_DIFF
+                }
+                else if(vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 && vg_b > -9 && vg_b < 8)
+                {
+                    out.push_back(static_cast<uint8_t>(0x80 | (vg + 32)));                                // QOI_OP_LUMA
+                    out.push_back(static_cast<uint8_t>((vg_r + 8) << 4 | (vg_b + 8)));
+                }
+                else
+                {
+                    out.push_back(0xfe);                                                                   // QOI_OP_RGB
+                    out.insert(out.end(), px.begin(), px.begin() + 3);
+                }
+            }
+
+            prev = px;
+        }
+
+        flush(out.data(), out.size());
+    }
+
+    uint64_t finish() override
+    {
+        out.clear();
+        emit_run();
+        const uint8_t end_marker[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+        out.insert(out.end(), end_marker, end_marker + sizeof(end_marker));
+        flush(out.data(), out.size());
+        file.close();
+        if(file.fail())
+            throw std::runtime_error("Writing the image failed.");
+        rename();
+        return bytes;
+    }
+
+private:
+    void emit_run()
+    {
+        if(run > 0)
+        {
+            out.push_back(static_cast<uint8_t>(0xc0 | (run - 1)));  // QOI_OP_RUN
+            run = 0;
+        }
+    }
+
+    void flush(const uint8_t* data, const size_t length)
+    {
+        write(file, data, length);
+        bytes += length;
+    }
+};
+
+/**
+ * The supported output formats.
+ */
+struct ImageWriter
+{
+    enum format : uint8_t {png, ppm, pam, qoi};
+
+    // the file extensions without the dot, in the order of the formats.
+    static const std::array<std::string, 4>& extensions()
+    {
+        static const std::array<std::string, 4> ext = {{"png", "ppm", "pam", "qoi"}};
+        return ext;
+    }
+
+    static const std::string& extension(const format f)
+    {
+        return extensions()[f];
+    }
+
+    /**
+     * Creates the file and writes the header.
+     * @param png_options Only used for png files. With more than one thread the multi threaded encoder is used, else
+     * libpng.
+     */
+    static std::unique_ptr<ImageStream> open(const format f, const std::string& file_name,
+                                             const uint32_t width, const uint32_t height,
+                                             const PngEncoder::Options& png_options,
+                                             const std::array<uint8_t, 3>& channel_order)
+    {
+        switch(f)
+        {
+            case ppm:
+            case pam:
+                return std::unique_ptr<ImageStream>(new NetpbmStream(file_name, width, height, channel_order, f == pam));
+            case qoi:
+                return std::unique_ptr<ImageStream>(new QoiStream(file_name, width, height, channel_order));
+            case png:
+            default:
+                if(png_options.threads > 1)
+                    return std::unique_ptr<ImageStream>(
+                        new ParallelPngStream(file_name, width, height, channel_order, png_options));
+                return std::unique_ptr<ImageStream>(
+                    new LibpngStream(file_name, width, height, channel_order, png_options.level, png_options.filter));
+        }
+    }
+};
+
+#endif //GENERATIVEART_IMAGE_WRITER_H
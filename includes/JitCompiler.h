@@ -0,0 +1,176 @@
+#ifndef GENERATIVEART_JIT_COMPILER_H
+#define GENERATIVEART_JIT_COMPILER_H
+
+#include "FunctionBaker.h"
+#include "RandomFunction.h"
+#include "ValueCache.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#include <sys/stat.h>
+#include <unistd.h>
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
+
+/**
+ * Compiles random functions at run time. The kernel of FunctionBaker is compiled by the system C compiler ($CC or cc)
+ * into a shared library, which gets loaded by dlopen. The libraries are kept in a directory, named by the hash of the
+ * code and the compiler command, so a function that was compiled before, by this or another process, is only loaded.
+ *
+ *     <directory>/<hash>.so               the compiled kernel
+ *     <directory>/<hash>.<pid>.c          the kernel while it gets compiled
+ *     <directory>/<hash>.so.<pid>.log    the errors of a failed compilation
+ *
+ * $CC is run by the shell as it is, like make does, so it may hold flags or a wrapper, e.g. CC="ccache gcc". It must
+ * not come from an untrusted source.
+ *
+ * If the compiler fails, e.g. because there is none, or dlopen is missing, compile() returns nullptr and the caller
+ * evaluates the function by the interpreter.
+ */
+class JitCompiler
+{
+public:
+    // see GenerativeArt::RowEvaluator
+    using RowEvaluator = void (*)(argument_type y, uint64_t x_px, uint32_t stride, uint32_t width,
+                                  argument_type step_size, argument_type x_min, argument_type* values);
+
+private:
+    const std::string directory;
+    const std::string compiler;
+
+    // the libraries loaded by this object by their hash
+    std::unordered_map<std::string, void*> libraries;
+
+    // false after the compiler failed once, then every function gets interpreted
+    bool available = true;
+
+public:
+    explicit JitCompiler(const std::string& directory)
+        : directory(directory.empty() || directory.back() == '/' ? directory : directory + "/"),
+          compiler(std::string(std::getenv("CC") ? std::getenv("CC") : "cc")
+                   + " -O3 -march=native -ffp-contract=off -fPIC -shared")
+    {
+        if(mkdir(this->directory.c_str(), 0755) != 0 && errno != EEXIST)
+            throw std::runtime_error("Could not create the directory " + this->directory);
+    }
+
+    ~JitCompiler()
+    {
+#ifndef _WIN32
+        for(const auto& library : libraries)
+            dlclose(library.second);
+#endif
+    }
+
+    JitCompiler(const JitCompiler&) = delete;
+    JitCompiler& operator=(const JitCompiler&) = delete;
+
+    const std::string& get_directory() const
+    {
+        return directory;
+    }
+
+    /**
+     * The compiled eval_row() of the function. It stays valid as long as this object.
+     * @param compiled Set to true if the function got compiled now, false if it was loaded from the directory.
+     * @return nullptr if the function cannot be compiled.
+     */
+    RowEvaluator compile(const RandomFunction& rf, bool& compiled)
+    {
+        compiled = false;
+        if(!available)
+            return nullptr;
+
+        const std::string code = FunctionBaker::kernel(rf);
+        const std::string hash = MappedValues::hash(compiler + "\n" + code);
+
+        const auto loaded = libraries.find(hash);
+        if(loaded != libraries.end())
+            return evaluator(loaded->second);
+
+        const std::string library = directory + hash + ".so";
+        struct stat st;
+        if(stat(library.c_str(), &st) != 0)
+        {
+            if(!build(code, hash, library))
+            {
+                available = false;
+                return nullptr;
+            }
+            compiled = true;
+        }
+
+        void* handle = load(library);
+        if(!handle)
+        {
+            available = false;
+            return nullptr;
+        }
+
+        libraries[hash] = handle;
+        return evaluator(handle);
+    }
+
+private:
+    /**
+     * Compiles the code into a temporary file that gets renamed to library, so other processes never load a library
+     * that is still written. The source file is named by the process too, so processes that compile the same
+     * function at the same time do not write into each other's source.
+     */
+    bool build(const std::string& code, const std::string& hash, const std::string& library) const
+    {
+        const std::string pid = std::to_string(getpid());
+        const std::string source = directory + hash + "." + pid + ".c";
+        const std::string temporary = library + "." + pid;
+
+        std::ofstream out(source);
+        out << code;
+        out.close();
+        if(!out)
+        {
+            std::remove(source.c_str());
+            return false;
+        }
+
+        // the compiler command is not quoted, see the class comment
+        const std::string command = compiler + " -o '" + temporary + "' '" + source + "' -lm 2> '" + temporary
+                                    + ".log'";
+        const int status = std::system(command.c_str());
+        std::remove(source.c_str());
+        if(status != 0)
+        {
+            std::remove(temporary.c_str());
+            return false;
+        }
+
+        std::remove((temporary + ".log").c_str());
+        return std::rename(temporary.c_str(), library.c_str()) == 0;
+    }
+
+    static void* load(const std::string& library)
+    {
+#ifdef _WIN32
+        return nullptr;
+#else
+        return dlopen(library.c_str(), RTLD_NOW | RTLD_LOCAL);
+#endif
+    }
+
+    static RowEvaluator evaluator(void* handle)
+    {
+#ifdef _WIN32
+        return nullptr;
+#else
+        return reinterpret_cast<RowEvaluator>(dlsym(handle, "eval_row"));
+#endif
+    }
+};
+
+#endif //GENERATIVEART_JIT_COMPILER_H
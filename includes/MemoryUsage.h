@@ -0,0 +1,81 @@
+#ifndef GENERATIVEART_MEMORY_USAGE_H
+#define GENERATIVEART_MEMORY_USAGE_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+/**
+ * The resident memory of this process, read from /proc/self/status on Linux.
+ *
+ * The peak (high-water mark) can be reset on Linux, so the peak of a single image can be measured. Elsewhere the peak
+ * is the peak since the start of the process, as reported by getrusage(), or unknown on Windows.
+ */
+class MemoryUsage
+{
+public:
+    /**
+     * The resident memory in bytes, 0 if unknown.
+     */
+    static uint64_t current()
+    {
+        return read_status("VmRSS:");
+    }
+
+    /**
+     * The largest resident memory in bytes since the start of the process or the last reset_peak().
+     */
+    static uint64_t peak()
+    {
+        const uint64_t hwm = read_status("VmHWM:");
+        if(hwm > 0)
+            return hwm;
+
+#ifdef _WIN32
+        return 0;
+#else
+        rusage usage;
+        if(getrusage(RUSAGE_SELF, &usage) != 0)
+            return 0;
+#ifdef __APPLE__
+        return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+        return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+    }
+
+    /**
+     * Sets the peak to the current resident memory.
+     * @return false if the peak cannot be reset, then peak() keeps the peak since the start of the process.
+     */
+    static bool reset_peak()
+    {
+        // see clear_refs in man 5 proc
+        std::ofstream clear_refs("/proc/self/clear_refs");
+        clear_refs << "5";
+        clear_refs.flush();
+        return static_cast<bool>(clear_refs);
+    }
+
+    static std::string megabytes(const uint64_t bytes)
+    {
+        return std::to_string((bytes + (1u << 19)) >> 20) + " MB";
+    }
+
+private:
+    static uint64_t read_status(const std::string& key)
+    {
+        std::ifstream status("/proc/self/status");
+        for(std::string line; std::getline(status, line);)
+            if(line.compare(0, key.size(), key) == 0)
+                return std::stoull(line.substr(key.size())) * 1024;    // in kB
+        return 0;
+    }
+};
+
+#endif //GENERATIVEART_MEMORY_USAGE_H
@@ -0,0 +1,286 @@
+#ifndef GENERATIVEART_NODE_PROFILE_H
+#define GENERATIVEART_NODE_PROFILE_H
+
+#include "FunctionPool.h"
+#include "RandomFunction.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * The evaluation time and the numeric health of every node of a random function on a grid of sample points.
+ *
+ * The function is evaluated node by node over the whole grid, the children first, so the time of a node is the time of
+ * its own function, applied to the values of its children, without the time of the children. Every node counts its NaN,
+ * infinite and denormal values. A NaN or infinite value is new, if the arguments of the node were not NaN or infinite,
+ * i.e. this node produced it, e.g. log of a negative number or exp of a large one.
+ */
+class NodeProfile
+{
+public:
+    struct Node
+    {
+        const RandomFunction* function;
+        // the fastest of the repetitions
+        double seconds = 0.0;
+
+        uint64_t nan = 0;
+        uint64_t inf = 0;
+        uint64_t denormal = 0;
+        uint64_t new_nan = 0;
+        uint64_t new_inf = 0;
+    };
+
+private:
+    // in the order of RandomFunction::print()
+    std::vector<Node> nodes;
+    uint64_t num_points;
+    double total_seconds = 0.0;
+
+public:
+    /**
+     * @param x, y The area of the image.
+     * @param grid The number of sample points along each axis.
+     * @param repetitions Every node is timed this often, the fastest time counts.
+     */
+    NodeProfile(const RandomFunction& rf, const Domain<argument_type>& x, const Domain<argument_type>& y,
+                const uint32_t grid = 128, const unsigned int repetitions = 3)
+        : num_points(static_cast<uint64_t>(grid) * grid)
+    {
+        std::vector<argument_type> xs(num_points);
+        std::vector<argument_type> ys(num_points);
+        for(uint32_t j = 0; j < grid; j++)
+            for(uint32_t i = 0; i < grid; i++)
+            {
+                xs[j * grid + i] = x.min + (x.max - x.min) * (static_cast<argument_type>(i) + 0.5f) / grid;
+                ys[j * grid + i] = y.min + (y.max - y.min) * (static_cast<argument_type>(j) + 0.5f) / grid;
+            }
+
+        profile(rf, xs, ys, std::max(repetitions, 1u));
+
+        for(const Node& node : nodes)
+            total_seconds += node.seconds;
+    }
+
+    const std::vector<Node>& get_nodes() const
+    {
+        return nodes;
+    }
+
+    /**
+     * The expression like RandomFunction::print(), every function annotated with its share of the evaluation time,
+     * its nanoseconds per pixel and its NaN, infinite and denormal values, e.g.
+     * 1.2 * sinh(...){41.5% 12.3ns, inf 2.1% (2.1% new)}
+     */
+    std::string print() const
+    {
+        size_t index = 0;
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(1) << total_seconds / num_points * 1e9 << "ns per pixel\nf = ";
+        print_node(out, index);
+        return out.str();
+    }
+
+    /**
+     * The nodes summed up by function of the pool, the most expensive first, one function per line.
+     */
+    std::string print_functions() const
+    {
+        struct Sum
+        {
+            std::string name;
+            unsigned int count = 0;
+            Node node{nullptr};
+        };
+
+        std::vector<Sum> sums(FunctionPool::unary.size() + FunctionPool::binary.size());
+        for(size_t f = 0; f < FunctionPool::unary.size(); f++)
+            sums[f].name = FunctionPool::unary_string[f].first + "x" + FunctionPool::unary_string[f].second;
+        for(size_t f = 0; f < FunctionPool::binary.size(); f++)
+            sums[FunctionPool::unary.size() + f].name = std::get<0>(FunctionPool::binary_string[f]) + "x"
+                                                        + std::get<1>(FunctionPool::binary_string[f]) + "y"
+                                                        + std::get<2>(FunctionPool::binary_string[f]);
+
+        for(const Node& node : nodes)
+        {
+            const RandomFunction& rf = *node.function;
+            if(rf.type == RandomFunction::terminal_index)
+                continue;
+
+            Sum& sum = sums[(rf.type == RandomFunction::binary ? FunctionPool::unary.size() : 0) + rf.function_index];
+            sum.count++;
+            sum.node.seconds += node.seconds;
+            sum.node.nan += node.nan;
+            sum.node.inf += node.inf;
+            sum.node.denormal += node.denormal;
+            sum.node.new_nan += node.new_nan;
+            sum.node.new_inf += node.new_inf;
+        }
+
+        std::stable_sort(sums.begin(), sums.end(), [](const Sum& a, const Sum& b)
+        {
+            return a.node.seconds > b.node.seconds;
+        });
+
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(1);
+        for(const Sum& sum : sums)
+        {
+            if(sum.count == 0)
+                continue;
+
+            // the health is the share of all values of these nodes
+            out << sum.name << ": " << sum.count << (sum.count > 1 ? " nodes " : " node ")
+                << annotation(sum.node, sum.count * num_points) << "\n";
+        }
+        return out.str();
+    }
+
+private:
+    std::vector<argument_type> profile(const RandomFunction& rf, const std::vector<argument_type>& xs,
+                                       const std::vector<argument_type>& ys, const unsigned int repetitions)
+    {
+        const size_t index = nodes.size();
+        nodes.push_back(Node{&rf});
+
+        std::vector<argument_type> a;
+        std::vector<argument_type> b;
+        if(rf.type != RandomFunction::terminal_index)
+            a = profile(*rf.child_function_1, xs, ys, repetitions);
+        if(rf.type == RandomFunction::binary)
+            b = profile(*rf.child_function_2, xs, ys, repetitions);
+
+        // the same operations as RandomFunction::eval()
+        std::vector<argument_type> values(num_points);
+        double seconds = std::numeric_limits<double>::max();
+        for(unsigned int r = 0; r < repetitions; r++)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            switch(rf.type)
+            {
+                case RandomFunction::unary:
+                {
+                    const auto& function = FunctionPool::unary[rf.function_index];
+                    for(size_t i = 0; i < num_points; i++)
+                        values[i] = rf.param * function(a[i]);
+                    break;
+                }
+                case RandomFunction::binary:
+                {
+                    const auto& function = FunctionPool::binary[rf.function_index];
+                    for(size_t i = 0; i < num_points; i++)
+                        values[i] = rf.param * function(a[i], b[i]);
+                    break;
+                }
+                default:
+                {
+                    const auto& arguments = rf.function_index ? xs : ys;
+                    for(size_t i = 0; i < num_points; i++)
+                        values[i] = rf.param * arguments[i];
+                }
+            }
+            seconds = std::min(seconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+                                        .count());
+        }
+
+        Node& node = nodes[index];
+        node.seconds = seconds;
+        for(size_t i = 0; i < num_points; i++)
+        {
+            const bool nan_argument = (!a.empty() && std::isnan(a[i])) || (!b.empty() && std::isnan(b[i]));
+            const bool inf_argument = (!a.empty() && std::isinf(a[i])) || (!b.empty() && std::isinf(b[i]));
+
+            switch(std::fpclassify(values[i]))
+            {
+                case FP_NAN:
+                    node.nan++;
+                    node.new_nan += !nan_argument;
+                    break;
+                case FP_INFINITE:
+                    node.inf++;
+                    node.new_inf += !nan_argument && !inf_argument;
+                    break;
+                case FP_SUBNORMAL:
+                    node.denormal++;
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        return values;
+    }
+
+    void print_node(std::ostringstream& out, size_t& index) const
+    {
+        const Node& node = nodes[index++];
+        const RandomFunction& rf = *node.function;
+
+        out << std::to_string(rf.param) << " * ";
+        switch(rf.type)
+        {
+            case RandomFunction::unary:
+                out << FunctionPool::unary_string[rf.function_index].first;
+                print_node(out, index);
+                out << FunctionPool::unary_string[rf.function_index].second;
+                break;
+            case RandomFunction::binary:
+                out << std::get<0>(FunctionPool::binary_string[rf.function_index]);
+                print_node(out, index);
+                out << std::get<1>(FunctionPool::binary_string[rf.function_index]);
+                print_node(out, index);
+                out << std::get<2>(FunctionPool::binary_string[rf.function_index]);
+                break;
+            default:
+                // the terminals cost nothing worth to be shown
+                out << (rf.function_index ? "x" : "y");
+                return;
+        }
+
+        out << annotation(node, num_points);
+    }
+
+    /**
+     * {share of the time, nanoseconds per pixel, shares of the NaN, infinite and denormal values}
+     * @param num_values The number of values the counts of the node are taken from.
+     */
+    std::string annotation(const Node& node, const uint64_t num_values) const
+    {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(1) << "{"
+            << (total_seconds > 0.0 ? 100.0 * node.seconds / total_seconds : 0.0) << "% "
+            << node.seconds / num_points * 1e9 << "ns";
+
+        const auto share = [&](const uint64_t count)
+        {
+            return 100.0 * static_cast<double>(count) / num_values;
+        };
+
+        if(node.nan > 0)
+        {
+            out << ", nan " << share(node.nan) << "%";
+            if(node.new_nan > 0)
+                out << " (" << share(node.new_nan) << "% new)";
+        }
+        if(node.inf > 0)
+        {
+            out << ", inf " << share(node.inf) << "%";
+            if(node.new_inf > 0)
+                out << " (" << share(node.new_inf) << "% new)";
+        }
+        if(node.denormal > 0)
+            out << ", denormal " << share(node.denormal) << "%";
+
+        out << "}";
+        return out.str();
+    }
+};
+
+#endif //GENERATIVEART_NODE_PROFILE_H
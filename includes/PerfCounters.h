@@ -0,0 +1,211 @@
+#ifndef GENERATIVEART_PERF_COUNTERS_H
+#define GENERATIVEART_PERF_COUNTERS_H
+
+#include <omp.h>
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Hardware and software event counts of the threads, read by perf_event_open on Linux.
+ *
+ * Every thread opens its own counters the first time it reads them and keeps them until it ends. Counters that the
+ * kernel or the cpu does not support, or that the kernel does not allow (see /proc/sys/kernel/perf_event_paranoid),
+ * are left out, the counts of the others are still valid. missing_reason() tells why counters are missing.
+ */
+class PerfCounters
+{
+public:
+    enum event : uint8_t {cycles, instructions, cache_references, cache_misses, branches, branch_misses, task_clock,
+                          page_faults, num_events};
+
+    static const char* event_name(const event e)
+    {
+        static const char* names[num_events] = {"cycles", "instructions", "cache_references", "cache_misses",
+                                                "branches", "branch_misses", "task_clock_ns", "page_faults"};
+        return names[e];
+    }
+
+    struct Counts
+    {
+        std::array<uint64_t, num_events> values = {};
+        // the events whose counters could be opened
+        std::array<bool, num_events> valid = {};
+
+        bool any_valid() const
+        {
+            for(const bool v : valid)
+                if(v)
+                    return true;
+            return false;
+        }
+
+        Counts& operator+=(const Counts& other)
+        {
+            for(size_t e = 0; e < num_events; e++)
+            {
+                values[e] += other.values[e];
+                valid[e] = valid[e] || other.valid[e];
+            }
+            return *this;
+        }
+
+        Counts operator-(const Counts& other) const
+        {
+            Counts difference = *this;
+            for(size_t e = 0; e < num_events; e++)
+                difference.values[e] = values[e] >= other.values[e] ? values[e] - other.values[e] : 0;
+            return difference;
+        }
+    };
+
+    /**
+     * The counts of the calling thread since it first read its counters.
+     */
+    static Counts thread_counts()
+    {
+        thread_local const PerfCounters counters;
+        return counters.read();
+    }
+
+    /**
+     * The sum of the counts of all threads of the OpenMP team. Must not be called in a parallel region. The threads
+     * of the team outlive the parallel regions, so the difference of two team counts contains all work of the team
+     * in between, including the time the threads wait.
+     */
+    static Counts team_counts()
+    {
+        Counts sum;
+        std::mutex mutex;
+
+#pragma omp parallel
+        {
+            const Counts counts = thread_counts();
+            std::lock_guard<std::mutex> lock(mutex);
+            sum += counts;
+        }
+
+        return sum;
+    }
+
+    /**
+     * Why counters of the calling thread could not be opened. Empty if all could be opened.
+     */
+    static std::string missing_reason()
+    {
+        thread_counts();
+        std::lock_guard<std::mutex> lock(reason_mutex());
+        return reason();
+    }
+
+private:
+    std::array<int, num_events> fds;
+
+    PerfCounters()
+    {
+        fds.fill(-1);
+
+#ifdef __linux__
+        static const std::array<std::pair<uint32_t, uint64_t>, num_events> events = {{
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+            {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+            {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS}
+        }};
+
+        int error = 0;
+        for(size_t e = 0; e < num_events; e++)
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = events[e].first;
+            attr.config = events[e].second;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            // the counters are multiplexed if there are more events than counters, the times scale the counts
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            // this thread on any cpu
+            fds[e] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+            if(fds[e] < 0 && error == 0)
+                error = errno;
+        }
+
+        if(error != 0)
+            set_reason(error);
+#else
+        set_reason(0);
+#endif
+    }
+
+    ~PerfCounters()
+    {
+#ifdef __linux__
+        for(const int fd : fds)
+            if(fd >= 0)
+                close(fd);
+#endif
+    }
+
+    Counts read() const
+    {
+        Counts counts;
+#ifdef __linux__
+        for(size_t e = 0; e < num_events; e++)
+        {
+            uint64_t data[3];
+            if(fds[e] < 0 || ::read(fds[e], data, sizeof(data)) != sizeof(data))
+                continue;
+
+            // value, time enabled, time running
+            counts.values[e] = data[2] > 0 && data[2] < data[1]
+                               ? static_cast<uint64_t>(static_cast<double>(data[0]) * data[1] / data[2]) : data[0];
+            counts.valid[e] = true;
+        }
+#endif
+        return counts;
+    }
+
+    static std::string& reason()
+    {
+        static std::string r;
+        return r;
+    }
+
+    static std::mutex& reason_mutex()
+    {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    static void set_reason(const int error)
+    {
+        std::lock_guard<std::mutex> lock(reason_mutex());
+
+        if(error == EACCES || error == EPERM)
+            reason() = "perf events are not permitted, see /proc/sys/kernel/perf_event_paranoid";
+        else if(error == ENOENT || error == EOPNOTSUPP || error == ENODEV)
+            reason() = "the cpu or the virtual machine does not provide all perf events";
+        else if(error == ENOSYS || error == 0)
+            reason() = "perf_event_open is not available on this system";
+        else
+            reason() = std::string("perf_event_open failed: ") + std::strerror(error);
+    }
+};
+
+#endif //GENERATIVEART_PERF_COUNTERS_H
@@ -0,0 +1,387 @@
+#ifndef GENERATIVEART_PNG_ENCODER_H
+#define GENERATIVEART_PNG_ENCODER_H
+
+#include <zlib.h>
+#include <omp.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * Parallel PNG encoder for 8 bit RGB images.
+ *
+ * The rows are split into bands. Every band is filtered and deflated on its own thread and ends with a sync flush,
+ * so the compressed bands can be concatenated to one valid zlib stream (pigz style). The last 32 KiB of the previous
+ * band are used as dictionary, so the compression ratio is close to a single threaded deflate. The Adler-32 checksums
+ * of the bands are combined into the checksum of the whole stream.
+ *
+ * Rows can be handed over in multiple calls of write_rows(), so images can be streamed band by band.
+ */
+class PngEncoder
+{
+public:
+    // The values match the filter bytes of the PNG specification. adaptive picks the best filter for every row.
+    enum filter_type : uint8_t {none = 0, sub = 1, up = 2, average = 3, paeth = 4, adaptive = 5};
+
+    struct Options
+    {
+        unsigned int threads = 1;
+        int level = Z_DEFAULT_COMPRESSION;
+        filter_type filter = adaptive;
+    };
+
+private:
+    static constexpr size_t window_size = 32768;
+    static constexpr size_t min_band_bytes = 256 * 1024;
+
+    std::ofstream file;
+
+    const uint32_t width;
+    const uint32_t height;
+    const size_t row_bytes;
+    const Options options;
+    const std::array<uint8_t, 3> channel_order;
+
+    uint32_t rows_written = 0;
+    uLong adler = adler32(0, Z_NULL, 0);
+    uint64_t bytes = 0;
+
+    // the last row handed over (already permuted) and the last filtered bytes, used as deflate dictionary.
+    std::vector<uint8_t> previous_row;
+    std::vector<uint8_t> dictionary;
+
+public:
+    /**
+     * Creates the file and writes the PNG header.
+     * @param file_name The path of the PNG file.
+     * @param channel_order The source channel for red, green and blue. This allows to write color permutations
+     * without copying the image.
+     */
+    PngEncoder(const std::string& file_name, const uint32_t width, const uint32_t height, const Options& options,
+               const std::array<uint8_t, 3> channel_order = {{0, 1, 2}})
+        : file(file_name, std::ios::binary),
+          width(width),
+          height(height),
+          row_bytes(3 * static_cast<size_t>(width)),
+          options(options),
+          channel_order(channel_order),
+          previous_row(row_bytes, 0)
+    {
+        if(!file.is_open())
+            throw std::runtime_error("Could not open " + file_name + " for writing.");
+
+        static const uint8_t signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+        write(signature, sizeof(signature));
+
+        uint8_t ihdr[13];
+        store_be32(ihdr, width);
+        store_be32(ihdr + 4, height);
+        ihdr[8] = 8;    // bit depth
+        ihdr[9] = 2;    // color type rgb
+        ihdr[10] = 0;   // compression method
+        ihdr[11] = 0;   // filter method
+        ihdr[12] = 0;   // no interlacing
+        write_chunk("IHDR", ihdr, sizeof(ihdr));
+
+        // zlib header. The level bits are informational only.
+        const int level = options.level < 0 ? 6 : options.level;
+        const uint8_t cmf = 0x78;
+        const uint8_t flevel = level < 2 ? 0 : (level < 6 ? 1 : (level == 6 ? 2 : 3));
+        uint8_t flg = static_cast<uint8_t>(flevel << 6);
+        flg = static_cast<uint8_t>(flg + (31 - (cmf * 256 + flg) % 31));
+        const uint8_t zlib_header[2] = {cmf, flg};
+        write_chunk("IDAT", zlib_header, sizeof(zlib_header));
+    }
+
+    /**
+     * Filters, compresses and writes the next rows of the image.
+     * @param rgb num_rows rows of interleaved rgb values.
+     */
+    void write_rows(const uint8_t* rgb, const uint32_t num_rows)
+    {
+        if(num_rows == 0)
+            return;
+        if(rows_written + static_cast<uint64_t>(num_rows) > height)
+            throw std::logic_error("More rows written than the image has.");
+
+        const size_t filtered_row_bytes = row_bytes + 1;
+        const uint32_t rows_per_band = static_cast<uint32_t>(std::max<size_t>(1, min_band_bytes / filtered_row_bytes));
+        const uint32_t num_bands = (num_rows + rows_per_band - 1) / rows_per_band;
+
+        std::vector<std::vector<uint8_t>> filtered(num_bands);
+        std::vector<std::vector<uint8_t>> compressed(num_bands);
+        std::vector<uLong> adlers(num_bands);
+
+        // exceptions must not leave the parallel regions, the first one is thrown after them
+        std::exception_ptr error;
+
+        // filter all bands first, because every band needs the end of the previous band as dictionary.
+#pragma omp parallel for schedule(dynamic) num_threads(std::max(1u, options.threads))
+        for(uint32_t band = 0; band < num_bands; band++)
+        {
+            try
+            {
+                const uint32_t first = band * rows_per_band;
+                const uint32_t last = std::min(num_rows, first + rows_per_band);
+
+                std::vector<uint8_t> prev(row_bytes), cur(row_bytes);
+                if(first == 0)
+                    prev = previous_row;
+                else
+                    permute_row(rgb + (first - 1) * row_bytes, prev.data());
+
+                auto& out = filtered[band];
+                out.resize((last - first) * filtered_row_bytes);
+                std::vector<uint8_t> scratch(filtered_row_bytes);
+
+                for(uint32_t row = first; row < last; row++)
+                {
+                    permute_row(rgb + row * row_bytes, cur.data());
+                    filter_row(cur.data(), prev.data(), out.data() + (row - first) * filtered_row_bytes,
+                               scratch.data());
+                    std::swap(prev, cur);
+                }
+
+                adlers[band] = adler32(adler32(0, Z_NULL, 0), out.data(), static_cast<uInt>(out.size()));
+            }
+            catch(...)
+            {
+                record(error);
+            }
+        }
+
+#pragma omp parallel for schedule(dynamic) num_threads(std::max(1u, options.threads))
+        for(uint32_t band = 0; band < num_bands; band++)
+        {
+            try
+            {
+                const std::vector<uint8_t>& dict = band == 0 ? dictionary : filtered[band - 1];
+                const size_t dict_size = std::min(window_size, dict.size());
+                compressed[band] = deflate_band(filtered[band], dict.data() + dict.size() - dict_size, dict_size);
+            }
+            catch(...)
+            {
+                record(error);
+            }
+        }
+
+        if(error)
+            std::rethrow_exception(error);
+
+        for(uint32_t band = 0; band < num_bands; band++)
+        {
+            adler = adler32_combine(adler, adlers[band], static_cast<z_off_t>(filtered[band].size()));
+            write_chunk("IDAT", compressed[band].data(), compressed[band].size());
+        }
+
+        // remember what the next call needs
+        permute_row(rgb + (num_rows - 1) * row_bytes, previous_row.data());
+        const auto& last_band = filtered[num_bands - 1];
+        const size_t keep = std::min(window_size, last_band.size());
+        dictionary.assign(last_band.end() - keep, last_band.end());
+
+        rows_written += num_rows;
+    }
+
+    /**
+     * Terminates the deflate stream and writes the end of the file. All rows must be written before.
+     */
+    void finish()
+    {
+        if(rows_written != height)
+            throw std::logic_error("The image is not complete.");
+
+        // an empty final block terminates the concatenated stream, followed by the adler checksum.
+        std::vector<uint8_t> tail = deflate_band({}, nullptr, 0, Z_FINISH);
+        uint8_t checksum[4];
+        store_be32(checksum, static_cast<uint32_t>(adler));
+        tail.insert(tail.end(), checksum, checksum + 4);
+        write_chunk("IDAT", tail.data(), tail.size());
+        write_chunk("IEND", nullptr, 0);
+
+        file.close();
+        if(file.fail())
+            throw std::runtime_error("Writing the PNG file failed.");
+    }
+
+    /**
+     * @return The number of bytes written to the file so far.
+     */
+    uint64_t bytes_written() const
+    {
+        return bytes;
+    }
+
+private:
+    static void store_be32(uint8_t* dst, const uint32_t value)
+    {
+        dst[0] = static_cast<uint8_t>(value >> 24);
+        dst[1] = static_cast<uint8_t>(value >> 16);
+        dst[2] = static_cast<uint8_t>(value >> 8);
+        dst[3] = static_cast<uint8_t>(value);
+    }
+
+    void write(const uint8_t* data, const size_t length)
+    {
+        file.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(length));
+        if(!file.good())
+            throw std::runtime_error("Writing the PNG file failed.");
+        bytes += length;
+    }
+
+    void write_chunk(const char* type, const uint8_t* data, const size_t length)
+    {
+        // chunks are limited to 2^31 - 1 bytes, but IDAT can be split anywhere.
+        constexpr size_t max_chunk = 1u << 30;
+        size_t offset = 0;
+        do
+        {
+            const size_t part = std::min(max_chunk, length - offset);
+            uint8_t head[8];
+            store_be32(head, static_cast<uint32_t>(part));
+            std::copy(type, type + 4, head + 4);
+            write(head, sizeof(head));
+
+            uLong crc = crc32(0, head + 4, 4);
+            if(part > 0)
+            {
+                write(data + offset, part);
+                crc = crc32(crc, data + offset, static_cast<uInt>(part));
+            }
+
+            uint8_t crc_bytes[4];
+            store_be32(crc_bytes, static_cast<uint32_t>(crc));
+            write(crc_bytes, sizeof(crc_bytes));
+
+            offset += part;
+        } while(offset < length);
+    }
+
+    void permute_row(const uint8_t* src, uint8_t* dst) const
+    {
+        for(size_t i = 0; i < row_bytes; i += 3)
+        {
+            dst[i] = src[i + channel_order[0]];
+            dst[i + 1] = src[i + channel_order[1]];
+            dst[i + 2] = src[i + channel_order[2]];
+        }
+    }
+
+    static uint8_t paeth_predictor(const int a, const int b, const int c)
+    {
+        const int p = a + b - c;
+        const int pa = std::abs(p - a);
+        const int pb = std::abs(p - b);
+        const int pc = std::abs(p - c);
+        if(pa <= pb && pa <= pc)
+            return static_cast<uint8_t>(a);
+        return static_cast<uint8_t>(pb <= pc ? b : c);
+    }
+
+    void apply_filter(const uint8_t type, const uint8_t* cur, const uint8_t* prev, uint8_t* out) const
+    {
+        constexpr size_t bpp = 3;
+        out[0] = type;
+        out++;
+        for(size_t i = 0; i < row_bytes; i++)
+        {
+            const uint8_t a = i >= bpp ? cur[i - bpp] : 0;
+            const uint8_t b = prev[i];
+            const uint8_t c = i >= bpp ? prev[i - bpp] : 0;
+            switch(type)
+            {
+                case sub:     out[i] = static_cast<uint8_t>(cur[i] - a); break;
+                case up:      out[i] = static_cast<uint8_t>(cur[i] - b); break;
+                case average: out[i] = static_cast<uint8_t>(cur[i] - ((a + b) >> 1)); break;
+                case paeth:   out[i] = static_cast<uint8_t>(cur[i] - paeth_predictor(a, b, c)); break;
+                default:      out[i] = cur[i];
+            }
+        }
+    }
+
+    void filter_row(const uint8_t* cur, const uint8_t* prev, uint8_t* out, uint8_t* scratch) const
+    {
+        if(options.filter != adaptive)
+        {
+            apply_filter(options.filter, cur, prev, out);
+            return;
+        }
+
+        // minimum sum of absolute differences heuristic, like libpng does.
+        uint64_t best_sum = std::numeric_limits<uint64_t>::max();
+        for(uint8_t type = none; type <= paeth; type++)
+        {
+            apply_filter(type, cur, prev, scratch);
+            uint64_t sum = 0;
+            for(size_t i = 1; i <= row_bytes; i++)
+                sum += static_cast<uint64_t>(std::abs(static_cast<int8_t>(scratch[i])));
+            if(sum < best_sum)
+            {
+                best_sum = sum;
+                std::copy(scratch, scratch + row_bytes + 1, out);
+            }
+        }
+    }
+
+    /**
+     * Keeps the exception that is handled in a parallel region, if it is the first one.
+     */
+    static void record(std::exception_ptr& error)
+    {
+#pragma omp critical(png_encoder_error)
+        if(!error)
+            error = std::current_exception();
+    }
+
+    std::vector<uint8_t> deflate_band(const std::vector<uint8_t>& input, const uint8_t* dict, const size_t dict_size,
+                                      const int flush = Z_SYNC_FLUSH) const
+    {
+        z_stream zs = {};
+        const int strategy = options.filter == none ? Z_DEFAULT_STRATEGY : Z_FILTERED;
+        if(deflateInit2(&zs, options.level, Z_DEFLATED, -15, 8, strategy) != Z_OK)
+            throw std::runtime_error("Could not initialize zlib.");
+
+        if(dict_size > 0 && deflateSetDictionary(&zs, dict, static_cast<uInt>(dict_size)) != Z_OK)
+        {
+            deflateEnd(&zs);
+            throw std::runtime_error("Could not set the zlib dictionary.");
+        }
+
+        std::vector<uint8_t> output(deflateBound(&zs, input.size()) + 16);
+        zs.next_in = const_cast<Bytef*>(input.data());
+        zs.avail_in = static_cast<uInt>(input.size());
+
+        size_t produced = 0;
+        while(true)
+        {
+            zs.next_out = output.data() + produced;
+            zs.avail_out = static_cast<uInt>(output.size() - produced);
+            const int ret = deflate(&zs, flush);
+            produced = output.size() - zs.avail_out;
+
+            if(ret == Z_STREAM_ERROR)
+            {
+                deflateEnd(&zs);
+                throw std::runtime_error("Deflating the image failed.");
+            }
+            if(zs.avail_in == 0 && zs.avail_out > 0 && (flush != Z_FINISH || ret == Z_STREAM_END))
+                break;
+
+            output.resize(output.size() * 2);
+        }
+
+        deflateEnd(&zs);
+        output.resize(produced);
+        return output;
+    }
+};
+
+#endif //GENERATIVEART_PNG_ENCODER_H
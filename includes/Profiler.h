@@ -0,0 +1,372 @@
+#ifndef GENERATIVEART_PROFILER_H
+#define GENERATIVEART_PROFILER_H
+
+#include "Tracer.h"
+#include "PerfCounters.h"
+
+#include <omp.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * Collects the time every sample of generate() spends in its stages. The parallel stages also record the busy time
+ * of every thread, i.e. the time a thread worked on its share of the pixels. Threads that are busy much shorter than
+ * others wait for them at the end of the stage.
+ *
+ * With perf counters the scopes also count the hardware events of all threads of the OpenMP team, e.g. cycles,
+ * instructions and cache misses.
+ *
+ * Every sample also records how its image buffers were held, their estimated peak memory and the peak resident memory
+ * of the process.
+ *
+ * With a tracer every scope is also recorded as an event of its thread, so the stages, the waits of the threads and
+ * the rejected samples can be seen on a timeline.
+ *
+ * The scopes do nothing without a profiler, so they can stay in the code. They also do nothing where several threads
+ * would record the same stage at once, i.e. a Scope in a parallel region or a ThreadScope in a nested one, e.g. while
+ * the tiles of a pyramid are rendered in parallel.
+ */
+class Profiler
+{
+public:
+    enum stage : uint8_t {draw_function, compile, draw_color_map, evaluate, prescreen, color, statistics, normalize,
+                          write, num_stages};
+
+    static const char* stage_name(const stage s)
+    {
+        static const char* names[num_stages] = {"draw_function", "compile", "draw_color_map", "evaluate", "prescreen",
+                                                "color", "statistics", "normalize", "write"};
+        return names[s];
+    }
+
+    using clock = Tracer::clock;
+
+    /**
+     * Measures the time until the end of the scope, or until stop(), as time of the stage. The times of several scopes
+     * of the same stage add up.
+     */
+    class Scope
+    {
+        Profiler* profiler;
+        const stage s;
+        const PerfCounters::Counts start_counts;
+        const clock::time_point start;
+
+    public:
+        Scope(Profiler* profiler, const stage s)
+            : profiler(omp_get_level() == 0 ? profiler : nullptr), s(s),
+              start_counts(this->profiler && this->profiler->perf_counters ? PerfCounters::team_counts()
+                                                                           : PerfCounters::Counts()),
+              start(this->profiler ? clock::now() : clock::time_point())
+        {}
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        ~Scope()
+        {
+            stop();
+        }
+
+        /**
+         * Ends the measurement before the end of the scope.
+         */
+        void stop()
+        {
+            if(!profiler)
+                return;
+
+            const auto end = clock::now();
+            profiler->current.stages[s].seconds += std::chrono::duration<double>(end - start).count();
+            if(profiler->perf_counters)
+                profiler->current.stages[s].counts += PerfCounters::team_counts() - start_counts;
+            if(profiler->tracer)
+                profiler->tracer->record(stage_name(s), start, end);
+            profiler = nullptr;
+        }
+    };
+
+    /**
+     * Measures the time until the end of the scope as busy time of the calling OpenMP thread. Must be used inside of
+     * a parallel region, before the work sharing loop, which must not wait at its end (nowait).
+     */
+    class ThreadScope
+    {
+        Profiler* const profiler;
+        const stage s;
+        const clock::time_point start;
+
+    public:
+        ThreadScope(Profiler* profiler, const stage s)
+            : profiler(omp_get_level() == 1 ? profiler : nullptr), s(s),
+              start(this->profiler ? clock::now() : clock::time_point())
+        {}
+
+        ~ThreadScope()
+        {
+            if(!profiler)
+                return;
+
+            // every thread writes only its own entry
+            const auto end = clock::now();
+            auto& busy = profiler->current.stages[s].thread_busy;
+            const auto thread = static_cast<size_t>(omp_get_thread_num());
+            if(thread < busy.size())
+                busy[thread] += std::chrono::duration<double>(end - start).count();
+            if(profiler->tracer)
+                profiler->tracer->record(stage_name(s), start, end);
+        }
+    };
+
+private:
+    struct StageTime
+    {
+        double seconds = 0.0;
+        std::vector<double> thread_busy;
+        PerfCounters::Counts counts;
+    };
+
+    struct Sample
+    {
+        unsigned int function_seed = 0;
+        unsigned int color_seed = 0;
+        uint64_t num_pixels = 0;
+        bool accepted = false;
+        double seconds = 0.0;
+        PerfCounters::Counts counts;
+
+        // how the image buffers were held, see GenerativeArt::strategy. Empty if the sample did not get that far.
+        const char* memory_strategy = "";
+        uint64_t estimated_bytes = 0;
+        uint64_t peak_rss_bytes = 0;
+        std::array<StageTime, num_stages> stages;
+    };
+
+    const size_t num_threads = static_cast<size_t>(omp_get_max_threads());
+    const bool perf_counters;
+
+    std::vector<Sample> samples;
+    Sample current;
+    clock::time_point sample_start;
+    PerfCounters::Counts sample_start_counts;
+
+    Tracer* tracer = nullptr;
+
+public:
+    /**
+     * @param perf_counters Counts the hardware events of every stage, see PerfCounters.
+     */
+    explicit Profiler(const bool perf_counters = false)
+        : perf_counters(perf_counters)
+    {}
+
+    /**
+     * @param t Must outlive this object. nullptr records no events.
+     */
+    void set_tracer(Tracer* t)
+    {
+        tracer = t;
+    }
+
+    Tracer* get_tracer() const
+    {
+        return tracer;
+    }
+
+    void begin_sample(const unsigned int function_seed, const unsigned int color_seed)
+    {
+        current = Sample();
+        current.function_seed = function_seed;
+        current.color_seed = color_seed;
+        for(auto& s : current.stages)
+            s.thread_busy.assign(num_threads, 0.0);
+        if(perf_counters)
+            sample_start_counts = PerfCounters::team_counts();
+        sample_start = clock::now();
+    }
+
+    /**
+     * @param strategy A string literal.
+     * @param estimated_bytes The estimated peak memory of the image buffers.
+     */
+    void set_memory_estimate(const char* strategy, const uint64_t estimated_bytes)
+    {
+        current.memory_strategy = strategy;
+        current.estimated_bytes = estimated_bytes;
+    }
+
+    /**
+     * @param peak_rss_bytes The peak resident memory of the process during the sample.
+     */
+    void end_sample(const uint64_t num_pixels, const bool accepted, const uint64_t peak_rss_bytes = 0)
+    {
+        const auto end = clock::now();
+        current.seconds = std::chrono::duration<double>(end - sample_start).count();
+        current.num_pixels = num_pixels;
+        current.accepted = accepted;
+        current.peak_rss_bytes = peak_rss_bytes;
+        if(perf_counters)
+            current.counts = PerfCounters::team_counts() - sample_start_counts;
+        samples.push_back(current);
+
+        if(tracer)
+            tracer->record(accepted ? "sample" : "rejected sample", sample_start, end,
+                           std::to_string(current.function_seed) + "." + std::to_string(current.color_seed));
+    }
+
+    /**
+     * Writes every sample and the sums over all samples as json.
+     */
+    void write_json(const std::string& file_name) const
+    {
+        std::ofstream out(file_name);
+        if(!out)
+            throw std::runtime_error("Could not open the profile " + file_name + ".");
+
+        Sample total;
+        for(auto& s : total.stages)
+            s.thread_busy.assign(num_threads, 0.0);
+
+        uint64_t num_accepted = 0;
+        uint64_t accepted_pixels = 0;
+        for(const Sample& sample : samples)
+        {
+            total.seconds += sample.seconds;
+            total.num_pixels += sample.num_pixels;
+            num_accepted += sample.accepted;
+            accepted_pixels += sample.accepted ? sample.num_pixels : 0;
+            total.counts += sample.counts;
+            total.estimated_bytes = std::max(total.estimated_bytes, sample.estimated_bytes);
+            total.peak_rss_bytes = std::max(total.peak_rss_bytes, sample.peak_rss_bytes);
+            for(size_t s = 0; s < num_stages; s++)
+            {
+                total.stages[s].seconds += sample.stages[s].seconds;
+                total.stages[s].counts += sample.stages[s].counts;
+                for(size_t t = 0; t < num_threads; t++)
+                    total.stages[s].thread_busy[t] += sample.stages[s].thread_busy[t];
+            }
+        }
+
+        out << std::setprecision(9) << "{\n  \"threads\": " << num_threads;
+        if(perf_counters && !PerfCounters::missing_reason().empty())
+            out << ",\n  \"missing_perf_counters\": \"" << PerfCounters::missing_reason() << "\"";
+        out << ",\n  \"aggregate\": {"
+            << "\"samples\": " << samples.size()
+            << ", \"accepted\": " << num_accepted
+            << ", \"rejected\": " << samples.size() - num_accepted
+            << ", \"rejection_rate\": " << (samples.empty() ? 0.0
+                                            : static_cast<double>(samples.size() - num_accepted) / samples.size())
+            << ", \"seconds\": " << total.seconds
+            << ", \"pixels\": " << total.num_pixels
+            << ", \"pixels_per_second\": " << rate(total.num_pixels, total.seconds)
+            << ", \"accepted_pixels_per_second\": " << rate(accepted_pixels, total.seconds)
+            << ", \"max_estimated_peak_bytes\": " << total.estimated_bytes
+            << ", \"max_peak_rss_bytes\": " << total.peak_rss_bytes;
+        write_counts(out, total.counts);
+        out << ", \"stages\": ";
+        write_stages(out, total);
+        out << "},\n  \"samples\": [";
+
+        for(size_t i = 0; i < samples.size(); i++)
+        {
+            const Sample& sample = samples[i];
+            out << (i > 0 ? "," : "") << "\n    {\"function_seed\": " << sample.function_seed
+                << ", \"color_seed\": " << sample.color_seed
+                << ", \"accepted\": " << (sample.accepted ? "true" : "false")
+                << ", \"seconds\": " << sample.seconds
+                << ", \"pixels\": " << sample.num_pixels
+                << ", \"pixels_per_second\": " << rate(sample.num_pixels, sample.seconds)
+                << ", \"memory\": {\"strategy\": \"" << sample.memory_strategy
+                << "\", \"estimated_peak_bytes\": " << sample.estimated_bytes
+                << ", \"peak_rss_bytes\": " << sample.peak_rss_bytes << "}";
+            write_counts(out, sample.counts);
+            out << ", \"stages\": ";
+            write_stages(out, sample);
+            out << "}";
+        }
+        out << "\n  ]\n}\n";
+    }
+
+private:
+    static double rate(const uint64_t pixels, const double seconds)
+    {
+        return seconds > 0.0 ? static_cast<double>(pixels) / seconds : 0.0;
+    }
+
+    /**
+     * Only the stages the sample went through are written. imbalance is the longest busy time of a thread divided by
+     * the mean busy time, 1 means all threads worked equally long.
+     */
+    static void write_stages(std::ofstream& out, const Sample& sample)
+    {
+        out << "{";
+        bool first = true;
+        for(size_t s = 0; s < num_stages; s++)
+        {
+            const StageTime& time = sample.stages[s];
+            if(time.seconds == 0.0)
+                continue;
+
+            out << (first ? "" : ", ") << "\"" << stage_name(static_cast<stage>(s)) << "\": {\"seconds\": "
+                << time.seconds << ", \"share\": " << (sample.seconds > 0.0 ? time.seconds / sample.seconds : 0.0);
+            first = false;
+
+            const double max_busy = *std::max_element(time.thread_busy.begin(), time.thread_busy.end());
+            if(max_busy > 0.0)
+            {
+                double sum_busy = 0.0;
+                out << ", \"thread_busy\": [";
+                for(size_t t = 0; t < time.thread_busy.size(); t++)
+                {
+                    out << (t > 0 ? ", " : "") << time.thread_busy[t];
+                    sum_busy += time.thread_busy[t];
+                }
+                out << "], \"imbalance\": " << max_busy / (sum_busy / time.thread_busy.size());
+            }
+
+            write_counts(out, time.counts);
+            out << "}";
+        }
+        out << "}";
+    }
+
+    /**
+     * Writes the valid counts as "counters" member, together with the instructions per cycle and the miss rates.
+     */
+    static void write_counts(std::ofstream& out, const PerfCounters::Counts& counts)
+    {
+        if(!counts.any_valid())
+            return;
+
+        out << ", \"counters\": {";
+        bool first = true;
+        for(size_t e = 0; e < PerfCounters::num_events; e++)
+        {
+            if(!counts.valid[e])
+                continue;
+            out << (first ? "" : ", ") << "\"" << PerfCounters::event_name(static_cast<PerfCounters::event>(e))
+                << "\": " << counts.values[e];
+            first = false;
+        }
+
+        const auto ratio = [&](const PerfCounters::event a, const PerfCounters::event b, const char* name)
+        {
+            if(counts.valid[a] && counts.valid[b] && counts.values[b] > 0)
+                out << ", \"" << name << "\": " << static_cast<double>(counts.values[a]) / counts.values[b];
+        };
+        ratio(PerfCounters::instructions, PerfCounters::cycles, "ipc");
+        ratio(PerfCounters::cache_misses, PerfCounters::cache_references, "cache_miss_rate");
+        ratio(PerfCounters::branch_misses, PerfCounters::branches, "branch_miss_rate");
+        out << "}";
+    }
+};
+
+#endif //GENERATIVEART_PROFILER_H
@@ -10,6 +10,7 @@
 #include <limits>
 #include <algorithm>
 #include <cassert>
+#include <cmath>
 
 template<typename T>
 struct Domain
@@ -33,6 +34,8 @@ struct Domain
 
 class RandomPolynomial
 {
+    friend class FunctionBaker;
+
     const std::vector<argument_type> poly;
 
 public:
@@ -73,6 +76,42 @@ public:
         return result;
     }
 
+    /**
+     * Bounds eval() on all x in [lo, hi], including the rounding errors of its float operations. The bounds come from
+     * Horner's scheme in interval arithmetic, widened by the error bound of Horner's scheme,
+     * |eval(x) - p(x)| <= 2n u / (1 - 2n u) * sum |a_i| |x|^i with u = 2^-24 (Higham, Accuracy and Stability of
+     * Numerical Algorithms, 5.1).
+     * @return false if eval() may overflow on the interval, then min and max are not set.
+     */
+    bool bounds(const argument_type lo, const argument_type hi, double& min, double& max) const
+    {
+        if(poly.empty())
+            return false;
+
+        const double x_abs = std::max(std::fabs(static_cast<double>(lo)), std::fabs(static_cast<double>(hi)));
+        double r_lo = poly[0], r_hi = poly[0];
+        double magnitude = std::fabs(poly[0]);
+
+        for(unsigned int i = 1; i < poly.size(); i++)
+        {
+            const double p1 = r_lo * lo, p2 = r_lo * hi, p3 = r_hi * lo, p4 = r_hi * hi;
+            r_lo = std::min(std::min(p1, p2), std::min(p3, p4)) + poly[i];
+            r_hi = std::max(std::max(p1, p2), std::max(p3, p4)) + poly[i];
+
+            // bounds every intermediate result of eval(), far below the largest float
+            magnitude = magnitude * x_abs + std::fabs(poly[i]);
+            if(!(magnitude < 1e30))
+                return false;
+        }
+
+        // the margin covers the rounding of the double operations above, the absolute term float underflow
+        const double two_n_u = 2.0 * poly.size() * std::ldexp(1.0, -24);
+        const double error = magnitude * (two_n_u / (1.0 - two_n_u) + 1e-12) + 1e-30;
+        min = r_lo - error;
+        max = r_hi + error;
+        return true;
+    }
+
     std::string print() const
     {
         std::string description = std::to_string(poly[0]);
@@ -88,6 +127,9 @@ public:
 
 class RandomFunction
 {
+    friend class NodeProfile;
+    friend class FunctionBaker;
+
     enum function_type {unary, binary, terminal_index};
 
     const unsigned int depth;
@@ -0,0 +1,153 @@
+#ifndef GENERATIVEART_RENDER_CACHE_H
+#define GENERATIVEART_RENDER_CACHE_H
+
+#include "ValueCache.h"
+
+#include <cerrno>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Index of already rendered images. An image is found by a key that contains every setting its pixels and its file
+ * format depend on. The cache keeps a hard link of every stored file, so the outputs of a hit are linked (or copied if
+ * that fails) from the cache instead of being rendered again. The links stay valid because an ImageStream replaces an
+ * existing output by a new file instead of writing into it.
+ *
+ * The index is split into 4096 append only shard files chosen by the hash of the key. A lookup reads only one shard,
+ * which holds a few hundred entries even with millions of images. Entries are appended with a single write to a file
+ * opened with O_APPEND, so several processes can share a cache.
+ *
+ *     <directory>/index/<first 3 hex digits of the hash>    lines of "<hash> <key>"
+ *     <directory>/objects/<hash>_<output number>.<ext>      the cached files
+ */
+class RenderCache
+{
+    const std::string directory;
+
+public:
+    explicit RenderCache(const std::string& directory)
+        : directory(directory.empty() || directory.back() == '/' ? directory : directory + "/")
+    {
+        make_directory(this->directory + "index");
+        make_directory(this->directory + "objects");
+    }
+
+    /**
+     * Links the cached files of the key to the outputs.
+     * @return false if the key is not in the cache or its files got removed.
+     */
+    bool restore(const std::string& key, const std::vector<std::string>& outputs) const
+    {
+        const std::string hash = MappedValues::hash(key);
+        if(!contains(hash, key))
+            return false;
+
+        for(size_t i = 0; i < outputs.size(); i++)
+        {
+            struct stat st = {};
+            if(stat(object_path(hash, i, outputs[i]).c_str(), &st) != 0)
+                return false;
+        }
+
+        for(size_t i = 0; i < outputs.size(); i++)
+            link_or_copy(object_path(hash, i, outputs[i]), outputs[i], true);
+
+        return true;
+    }
+
+    /**
+     * Adds the written outputs to the cache. The files are linked first, so an entry in the index always has its
+     * files.
+     */
+    void store(const std::string& key, const std::vector<std::string>& outputs) const
+    {
+        const std::string hash = MappedValues::hash(key);
+
+        for(size_t i = 0; i < outputs.size(); i++)
+            link_or_copy(outputs[i], object_path(hash, i, outputs[i]), false);
+
+        const std::string entry = hash + " " + key + "\n";
+        const int fd = open(shard_path(hash).c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if(fd < 0)
+            throw std::runtime_error("Could not open the render cache index " + shard_path(hash));
+
+        const ssize_t written = write(fd, entry.data(), entry.size());
+        close(fd);
+        if(written != static_cast<ssize_t>(entry.size()))
+            throw std::runtime_error("Could not write the render cache index " + shard_path(hash));
+    }
+
+private:
+    bool contains(const std::string& hash, const std::string& key) const
+    {
+        std::ifstream shard(shard_path(hash));
+        const std::string entry = hash + " " + key;
+
+        // a line that is appended right now may be incomplete, but then it does not match either
+        std::string line;
+        while(std::getline(shard, line))
+            if(line == entry)
+                return true;
+
+        return false;
+    }
+
+    std::string shard_path(const std::string& hash) const
+    {
+        return directory + "index/" + hash.substr(0, 3);
+    }
+
+    std::string object_path(const std::string& hash, const size_t i, const std::string& output) const
+    {
+        const auto dot = output.find_last_of('.');
+        const std::string extension = dot == std::string::npos ? "" : output.substr(dot);
+        return directory + "objects/" + hash + "_" + std::to_string(i) + extension;
+    }
+
+    /**
+     * Hard links from to to. If the link fails, e.g. because the files are on different file systems, the file is
+     * copied.
+     * @param replace Replace an existing file at to, else an existing file is kept.
+     */
+    static void link_or_copy(const std::string& from, const std::string& to, const bool replace)
+    {
+        if(replace)
+            unlink(to.c_str());
+
+        if(link(from.c_str(), to.c_str()) == 0 || (!replace && errno == EEXIST))
+            return;
+
+        // copy to a temporary file first, so nobody sees half copied files
+        const std::string tmp = to + ".tmp." + std::to_string(getpid());
+        {
+            std::ifstream src(from, std::ios::binary);
+            std::ofstream dst(tmp, std::ios::binary);
+            dst << src.rdbuf();
+            if(!src.good() || !dst.good())
+            {
+                std::remove(tmp.c_str());
+                throw std::runtime_error("Could not copy " + from + " to " + to);
+            }
+        }
+
+        if(std::rename(tmp.c_str(), to.c_str()) != 0)
+        {
+            std::remove(tmp.c_str());
+            throw std::runtime_error("Could not copy " + from + " to " + to);
+        }
+    }
+
+    static void make_directory(const std::string& path)
+    {
+        if(mkdir(path.c_str(), 0755) != 0 && errno != EEXIST)
+            throw std::runtime_error("Could not create the directory " + path);
+    }
+};
+
+#endif //GENERATIVEART_RENDER_CACHE_H
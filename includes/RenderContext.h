@@ -0,0 +1,106 @@
+#ifndef GENERATIVEART_RENDER_CONTEXT_H
+#define GENERATIVEART_RENDER_CONTEXT_H
+
+#include "Buffer.h"
+#include "FunctionPool.h"
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+/**
+ * The image buffers of a generator, kept from one image to the next. A buffer only grows, so rendering many images of
+ * the same size allocates and faults in the memory only once.
+ *
+ * The color buffers are handed out and given back, since the colors of an image may still be encoded by the
+ * background writer while the next image is rendered. Up to max_free_colors buffers are kept for later images.
+ */
+class RenderContext
+{
+    static constexpr size_t max_free_colors = 2;
+
+    const bool huge_pages;
+
+    Buffer<argument_type> values;
+
+    std::mutex mutex;
+    std::vector<Buffer<uint8_t>> free_colors;
+
+public:
+    /**
+     * @param huge_pages Asks the kernel to back the buffers by transparent huge pages, which saves page faults and
+     * TLB misses on large images.
+     */
+    explicit RenderContext(const bool huge_pages = false)
+        : huge_pages(huge_pages)
+    {}
+
+    /**
+     * @return A buffer for at least num_values values. It is only valid until the next call.
+     */
+    argument_type* get_values(const uint64_t num_values)
+    {
+        grow(values, num_values);
+        return values.data();
+    }
+
+    /**
+     * @return A buffer of at least size bytes. It can be given back by recycle().
+     */
+    Buffer<uint8_t> get_colors(const uint64_t size)
+    {
+        Buffer<uint8_t> colors;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(!free_colors.empty())
+            {
+                colors = std::move(free_colors.back());
+                free_colors.pop_back();
+            }
+        }
+
+        grow(colors, size);
+        return colors;
+    }
+
+    void recycle(Buffer<uint8_t> colors)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(free_colors.size() < max_free_colors)
+            free_colors.push_back(std::move(colors));
+    }
+
+private:
+    template<typename T>
+    void grow(Buffer<T>& buffer, const uint64_t size) const
+    {
+        if(buffer.size() >= size)
+            return;
+
+        // the old values are not needed, so they are not copied
+        Buffer<T>().swap(buffer);
+        buffer.resize(size);
+
+        if(huge_pages)
+            advise_huge_pages(buffer.data(), size * sizeof(T));
+    }
+
+    /**
+     * Must be called before the memory is touched.
+     */
+    static void advise_huge_pages(void* data, const size_t bytes)
+    {
+#ifdef MADV_HUGEPAGE
+        const auto page_size = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+        const uintptr_t begin = (reinterpret_cast<uintptr_t>(data) + page_size - 1) / page_size * page_size;
+        const uintptr_t end = (reinterpret_cast<uintptr_t>(data) + bytes) / page_size * page_size;
+        if(end > begin)
+            madvise(reinterpret_cast<void*>(begin), end - begin, MADV_HUGEPAGE);
+#endif
+    }
+};
+
+#endif //GENERATIVEART_RENDER_CONTEXT_H
@@ -0,0 +1,293 @@
+#ifndef GENERATIVEART_RENDER_SERVER_H
+#define GENERATIVEART_RENDER_SERVER_H
+
+#include "GenerativeArt.h"
+#include "BlockingQueue.h"
+#include "RenderContext.h"
+
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+ * Renders images on request of local clients. The server keeps running, so the process start, the command line
+ * parsing and the creation of the OpenMP threads are paid only once.
+ *
+ * Clients connect to a Unix domain socket and send one command per line:
+ *
+ *     RENDER <file name> <resolution> <output path>
+ *         Renders the image encoded in the file name (see Settings::get_file_name()) with the given resolution,
+ *         which is scaled to the domain like the one of the command line unless --no-scale is set.
+ *         The file extension of the output path is replaced by the one of the output format. Answers
+ *         "OK <written files>", "REJECTED" for single color images or "ERR <message>".
+ *     PING
+ *         Answers "PONG".
+ *     QUIT
+ *         Closes the connection.
+ *     SHUTDOWN
+ *         Stops the server after all queued jobs are done.
+ *
+ * Every client is served by its own thread. The jobs of all clients go into one bounded queue that is processed by a
+ * single render thread, which uses all OpenMP threads for every image. A full queue blocks the clients.
+ */
+class RenderServer
+{
+    struct Job
+    {
+        std::string file_name;
+        unsigned int resolution;
+        std::string output_file;
+        std::promise<std::string> reply;
+    };
+
+    const GenerativeArt::Settings& base_settings;
+    const std::string socket_path;
+
+    BlockingQueue<std::unique_ptr<Job>> jobs;
+
+    // the image buffers of all jobs, they are rendered one after another
+    const std::shared_ptr<RenderContext> context;
+
+    int listen_fd = -1;
+    std::atomic<bool> running{true};
+
+    std::mutex clients_mutex;
+    std::vector<int> client_fds;
+
+    // the clients that disconnected, their threads get joined by the accept loop
+    std::vector<std::thread::id> finished_clients;
+
+public:
+    /**
+     * @param settings All settings that are not encoded in the file names, e.g. the output format.
+     */
+    RenderServer(const GenerativeArt::Settings& settings, std::string socket_path, const size_t queue_size)
+        : base_settings(settings),
+          socket_path(std::move(socket_path)),
+          jobs(queue_size),
+          context(std::make_shared<RenderContext>(settings.huge_pages))
+    {}
+
+    /**
+     * Accepts clients until a client sends SHUTDOWN.
+     */
+    void run()
+    {
+        listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(listen_fd < 0)
+            throw std::runtime_error("Could not create the socket.");
+
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if(socket_path.size() >= sizeof(address.sun_path))
+            throw std::runtime_error("The socket path is too long.");
+        std::copy(socket_path.begin(), socket_path.end(), address.sun_path);
+
+        unlink(socket_path.c_str());
+        if(bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listen_fd, 64) != 0)
+            throw std::runtime_error("Could not listen on " + socket_path);
+
+        verbose(base_settings.verbose, "Listening on " + socket_path);
+
+        std::thread renderer(&RenderServer::render_jobs, this);
+        std::vector<std::thread> clients;
+
+        while(running)
+        {
+            const int fd = accept(listen_fd, nullptr, nullptr);
+            if(fd < 0)
+            {
+                if(errno == EINTR)
+                    continue;
+                break;  // the socket got shut down
+            }
+
+            std::lock_guard<std::mutex> lock(clients_mutex);
+            join_finished_clients(clients);
+            client_fds.push_back(fd);
+            clients.emplace_back(&RenderServer::serve_client, this, fd);
+        }
+
+        // finish the queued jobs and disconnect all clients
+        jobs.close();
+        renderer.join();
+
+        {
+            std::lock_guard<std::mutex> lock(clients_mutex);
+            for(const int fd : client_fds)
+                shutdown(fd, SHUT_RDWR);
+        }
+        for(auto& client : clients)
+            client.join();
+
+        close(listen_fd);
+        unlink(socket_path.c_str());
+    }
+
+private:
+    void stop()
+    {
+        running = false;
+        shutdown(listen_fd, SHUT_RDWR);
+    }
+
+    void render_jobs()
+    {
+        std::unique_ptr<Job> job;
+        while(jobs.pop(job))
+            job->reply.set_value(render(*job));
+    }
+
+    std::string render(const Job& job) const
+    {
+        try
+        {
+            GenerativeArt::Settings settings = base_settings;
+            settings.read_file_name(job.file_name, base_settings.file_name_pt,
+                                    base_settings.file_name_x, base_settings.file_name_y);
+            settings.resolution = job.resolution;
+            settings.output_file = job.output_file;
+            settings.num_samples = 1;
+
+            // the same as on the command line, the resolution is for the shorter edge of the domain
+            if(settings.scale)
+                settings.scale_resolution();
+
+            verbose(settings.verbose, "Rendering " + job.file_name + " with " + std::to_string(settings.resolution)
+                                      + "px to " + job.output_file);
+
+            GenerativeArt ga(settings, context);
+            if(!ga.generate())
+                return "REJECTED";
+
+            std::string reply = "OK";
+            for(const auto& name : ga.get_output_names(settings.random_function_seed, settings.color_map_seed))
+                reply += " " + name;
+            return reply;
+        }
+        catch(const std::exception& e)
+        {
+            return std::string("ERR ") + e.what();
+        }
+    }
+
+    void serve_client(const int fd)
+    {
+        std::string buffer;
+        char chunk[4096];
+
+        while(true)
+        {
+            const auto newline = buffer.find('\n');
+            if(newline == std::string::npos)
+            {
+                const ssize_t n = read(fd, chunk, sizeof(chunk));
+                if(n <= 0)
+                    break;
+                buffer.append(chunk, static_cast<size_t>(n));
+                continue;
+            }
+
+            std::string line = buffer.substr(0, newline);
+            buffer.erase(0, newline + 1);
+            if(!line.empty() && line.back() == '\r')
+                line.pop_back();
+
+            std::istringstream command_line(line);
+            std::string command;
+            command_line >> command;
+
+            if(command == "PING")
+            {
+                send_line(fd, "PONG");
+            }
+            else if(command == "QUIT")
+            {
+                break;
+            }
+            else if(command == "SHUTDOWN")
+            {
+                send_line(fd, "OK");
+                stop();
+                break;
+            }
+            else if(command == "RENDER")
+            {
+                std::unique_ptr<Job> job(new Job());
+                if(!(command_line >> job->file_name >> job->resolution >> job->output_file) || job->resolution == 0)
+                {
+                    send_line(fd, "ERR usage: RENDER <file name> <resolution> <output path>");
+                    continue;
+                }
+
+                auto reply = job->reply.get_future();
+                if(!jobs.push(std::move(job)))
+                {
+                    send_line(fd, "ERR the server is shutting down");
+                    break;
+                }
+                send_line(fd, reply.get());
+            }
+            else if(!command.empty())
+            {
+                send_line(fd, "ERR unknown command " + command);
+            }
+        }
+
+        close_client(fd);
+    }
+
+    void close_client(const int fd)
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        client_fds.erase(std::remove(client_fds.begin(), client_fds.end(), fd), client_fds.end());
+        close(fd);
+        finished_clients.push_back(std::this_thread::get_id());
+    }
+
+    /**
+     * Joins the threads of the clients that disconnected, so a long running server does not keep a thread for every
+     * client it ever served. The caller holds clients_mutex. The threads only return after close_client(), so the join
+     * does not wait long.
+     */
+    void join_finished_clients(std::vector<std::thread>& clients)
+    {
+        for(const auto id : finished_clients)
+        {
+            const auto client = std::find_if(clients.begin(), clients.end(), [id](const std::thread& thread){
+                return thread.get_id() == id;
+            });
+            if(client != clients.end())
+            {
+                client->join();
+                clients.erase(client);
+            }
+        }
+        finished_clients.clear();
+    }
+
+    static void send_line(const int fd, const std::string& line)
+    {
+        const std::string message = line + "\n";
+        size_t sent = 0;
+        while(sent < message.size())
+        {
+            const ssize_t n = send(fd, message.data() + sent, message.size() - sent, MSG_NOSIGNAL);
+            if(n <= 0)
+                return;
+            sent += static_cast<size_t>(n);
+        }
+    }
+};
+
+#endif //GENERATIVEART_RENDER_SERVER_H
@@ -0,0 +1,96 @@
+#ifndef GENERATIVEART_SEED_STREAM_H
+#define GENERATIVEART_SEED_STREAM_H
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+/**
+ * Counter based source of seeds. The seeds of the sample with index i are a hash of (base, i), so every sample can be
+ * reproduced from the base and its index without drawing the samples before it.
+ *
+ * Shard i of n uses the indices i, i + n, i + 2n, ... Processes with the same base and different shards never use
+ * the same index and the hash is a bijection of the index, so they never draw the same pair of seeds.
+ */
+class SeedStream
+{
+    const uint64_t base;
+    const uint64_t shard;
+    const uint64_t num_shards;
+    uint64_t counter;
+
+public:
+    /**
+     * @param first The number of indices of this shard to skip.
+     */
+    SeedStream(const uint64_t base, const uint64_t shard, const uint64_t num_shards, const uint64_t first = 0)
+        : base(base),
+          shard(shard),
+          num_shards(num_shards),
+          counter(first)
+    {}
+
+    /**
+     * @return The next index of this shard. Every generated image, accepted or not, uses one index.
+     */
+    uint64_t next_index()
+    {
+        return shard + num_shards * counter++;
+    }
+
+    /**
+     * The function seed and the color seed of the sample with the given index. Zero means "not set" for seeds, so
+     * it is replaced by one.
+     */
+    static std::pair<unsigned int, unsigned int> seeds(const uint64_t base, const uint64_t index)
+    {
+        const uint64_t h = mix(base + (index + 1) * 0x9e3779b97f4a7c15ull);
+
+        const auto function_seed = static_cast<unsigned int>(h & 0xffffffffu);
+        const auto color_seed = static_cast<unsigned int>(h >> 32);
+        return {function_seed ? function_seed : 1u, color_seed ? color_seed : 1u};
+    }
+
+    std::pair<unsigned int, unsigned int> seeds(const uint64_t index) const
+    {
+        return seeds(base, index);
+    }
+
+    /**
+     * Parses "i/n".
+     * @return An error message, empty if the shard is valid.
+     */
+    static std::string parse_shard(const std::string& str, unsigned int& shard, unsigned int& num_shards)
+    {
+        const auto slash = str.find('/');
+        try
+        {
+            if(slash == std::string::npos)
+                throw std::invalid_argument(str);
+
+            shard = static_cast<unsigned int>(std::stoul(str.substr(0, slash)));
+            num_shards = static_cast<unsigned int>(std::stoul(str.substr(slash + 1)));
+        }
+        catch(const std::exception&)
+        {
+            return "The shard must be given as i/n.";
+        }
+
+        if(num_shards == 0 || shard >= num_shards)
+            return "The shard i/n needs 0 <= i < n.";
+
+        return "";
+    }
+
+private:
+    // the finalizer of splitmix64, a bijection on 64 bit integers.
+    static uint64_t mix(uint64_t z)
+    {
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+};
+
+#endif //GENERATIVEART_SEED_STREAM_H
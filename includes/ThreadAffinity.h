@@ -0,0 +1,105 @@
+#ifndef GENERATIVEART_THREAD_AFFINITY_H
+#define GENERATIVEART_THREAD_AFFINITY_H
+
+#include <omp.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <sched.h>
+
+/**
+ * Pins the OpenMP threads to cpus, so a thread keeps working on the memory it touched first.
+ *
+ * compact fills the cpus of one socket before the next socket is used, which keeps small teams on one memory node.
+ * spread alternates between the sockets, which uses the memory bandwidth of all sockets.
+ */
+class ThreadAffinity
+{
+public:
+    enum mode : uint8_t {none, compact, spread};
+
+    /**
+     * Pins every thread of the OpenMP team to one cpu of the cpus this process may use. The runtime keeps the
+     * threads for later parallel regions, so they stay pinned.
+     * @return A description of the placement, "thread:cpu" for every thread.
+     */
+    static std::string pin_threads(const mode m)
+    {
+        if(m == none)
+            return "";
+
+        const std::vector<int> cpus = cpu_order(m);
+        if(cpus.empty())
+            return "";
+
+        std::vector<int> placement(static_cast<size_t>(omp_get_max_threads()), -1);
+
+#pragma omp parallel
+        {
+            const auto t = static_cast<size_t>(omp_get_thread_num());
+            const int cpu = cpus[t % cpus.size()];
+
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            if(sched_setaffinity(0, sizeof(set), &set) == 0 && t < placement.size())
+                placement[t] = cpu;
+        }
+
+        std::string description;
+        for(size_t t = 0; t < placement.size(); t++)
+            description += (t > 0 ? " " : "") + std::to_string(t) + ":"
+                           + (placement[t] >= 0 ? std::to_string(placement[t]) : "-");
+        return description;
+    }
+
+    /**
+     * The cpus this process may use in the order the threads get them.
+     */
+    static std::vector<int> cpu_order(const mode m)
+    {
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+            return {};
+
+        // the cpus of every socket, ordered by their numbers. Linux numbers the second hardware thread of a core
+        // after all cores, so the cores come first.
+        std::map<int, std::vector<int>> sockets;
+        for(int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            if(CPU_ISSET(cpu, &allowed))
+                sockets[socket_of(cpu)].push_back(cpu);
+
+        std::vector<int> order;
+        if(m == compact)
+        {
+            for(const auto& socket : sockets)
+                order.insert(order.end(), socket.second.begin(), socket.second.end());
+            return order;
+        }
+
+        for(size_t i = 0; order.size() < static_cast<size_t>(CPU_COUNT(&allowed)); i++)
+            for(const auto& socket : sockets)
+                if(i < socket.second.size())
+                    order.push_back(socket.second[i]);
+
+        return order;
+    }
+
+private:
+    static int socket_of(const int cpu)
+    {
+        std::ifstream file("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/physical_package_id");
+        int socket = 0;
+        if(!(file >> socket))
+            return 0;
+        return socket;
+    }
+};
+
+#endif //GENERATIVEART_THREAD_AFFINITY_H
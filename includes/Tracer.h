@@ -0,0 +1,131 @@
+#ifndef GENERATIVEART_TRACER_H
+#define GENERATIVEART_TRACER_H
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * Records what every thread did when, in the Chrome trace event format, which can be opened in Perfetto or
+ * chrome://tracing.
+ *
+ * Every thread appends to its own buffer, so recording takes no lock. Only the first event of a thread registers its
+ * buffer under a lock. The buffers are written when the run is over.
+ */
+class Tracer
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+private:
+    struct Event
+    {
+        // a literal, only the detail is copied
+        const char* name;
+        clock::time_point begin;
+        clock::time_point end;
+        std::string detail;
+    };
+
+    struct ThreadBuffer
+    {
+        size_t id;
+        std::vector<Event> events;
+    };
+
+    const clock::time_point start = clock::now();
+
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+
+public:
+    Tracer() = default;
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+    /**
+     * Records that the calling thread worked on name from begin to end.
+     * @param name Must be a string literal.
+     * @param detail Shown as argument of the event, e.g. a file name.
+     */
+    void record(const char* name, const clock::time_point begin, const clock::time_point end,
+                std::string detail = "")
+    {
+        local_buffer().events.push_back({name, begin, end, std::move(detail)});
+    }
+
+    /**
+     * Writes the events of all threads. No thread may record events anymore.
+     */
+    void write_json(const std::string& file_name) const
+    {
+        std::ofstream out(file_name);
+        if(!out)
+            throw std::runtime_error("Could not open the trace " + file_name + ".");
+
+        out << std::fixed << std::setprecision(3) << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+        bool first = true;
+        for(const auto& buffer : buffers)
+        {
+            out << (first ? "" : ",") << "\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "
+                << buffer->id << ", \"args\": {\"name\": \"thread " << buffer->id << "\"}}";
+            first = false;
+
+            for(const Event& event : buffer->events)
+            {
+                out << ",\n{\"name\": \"" << event.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer->id
+                    << ", \"ts\": " << microseconds(start, event.begin)
+                    << ", \"dur\": " << microseconds(event.begin, event.end);
+                if(!event.detail.empty())
+                    out << ", \"args\": {\"detail\": \"" << escape(event.detail) << "\"}";
+                out << "}";
+            }
+        }
+        out << "\n]}\n";
+    }
+
+private:
+    ThreadBuffer& local_buffer()
+    {
+        // there is only one tracer per run, a thread registers again only if it records to another one
+        thread_local ThreadBuffer* buffer = nullptr;
+        thread_local const Tracer* owner = nullptr;
+
+        if(owner != this)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            buffers.emplace_back(new ThreadBuffer{buffers.size(), {}});
+            buffers.back()->events.reserve(1024);
+            buffer = buffers.back().get();
+            owner = this;
+        }
+
+        return *buffer;
+    }
+
+    static double microseconds(const clock::time_point from, const clock::time_point to)
+    {
+        return std::chrono::duration<double, std::micro>(to - from).count();
+    }
+
+    static std::string escape(const std::string& s)
+    {
+        std::string escaped;
+        for(const char c : s)
+        {
+            if(c == '"' || c == '\\')
+                escaped += '\\';
+            if(static_cast<unsigned char>(c) >= 0x20)
+                escaped += c;
+        }
+        return escaped;
+    }
+};
+
+#endif //GENERATIVEART_TRACER_H
@@ -0,0 +1,183 @@
+#ifndef GENERATIVEART_VALUE_CACHE_H
+#define GENERATIVEART_VALUE_CACHE_H
+
+#include "FunctionPool.h"
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * The values of the random function for every pixel, stored in a memory mapped file. The file starts with a header
+ * that contains a key describing everything the values depend on, so a file is only used for the exact same function
+ * and pixel grid.
+ *
+ * New files are created under a temporary name, filled through the mapping and renamed by commit(), so concurrent
+ * runs never see half written files.
+ */
+class MappedValues
+{
+    // magic, key length, number of values, key. The values start at the next multiple of 64 bytes.
+    struct Header
+    {
+        char magic[8];
+        uint64_t key_length;
+        uint64_t num_values;
+    };
+
+    std::string path;
+    std::string tmp_path;
+
+    void* base = MAP_FAILED;
+    size_t size = 0;
+    size_t data_offset = 0;
+
+    MappedValues() = default;
+
+public:
+    MappedValues(const MappedValues&) = delete;
+    MappedValues& operator=(const MappedValues&) = delete;
+
+    ~MappedValues()
+    {
+        if(base != MAP_FAILED)
+            munmap(base, size);
+        if(!tmp_path.empty())
+            std::remove(tmp_path.c_str());
+    }
+
+    /**
+     * Maps an existing values file.
+     * @return nullptr if there is no file or the file belongs to another key.
+     */
+    static std::unique_ptr<MappedValues> load(const std::string& path, const std::string& key, const uint64_t num_values)
+    {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if(fd < 0)
+            return nullptr;
+
+        struct stat st = {};
+        std::unique_ptr<MappedValues> mapping(new MappedValues());
+        mapping->path = path;
+        mapping->data_offset = get_data_offset(key);
+        mapping->size = mapping->data_offset + num_values * sizeof(argument_type);
+
+        if(fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) != mapping->size)
+        {
+            close(fd);
+            return nullptr;
+        }
+
+        mapping->base = mmap(nullptr, mapping->size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if(mapping->base == MAP_FAILED)
+            return nullptr;
+
+        const auto* header = static_cast<const Header*>(mapping->base);
+        const char* stored_key = static_cast<const char*>(mapping->base) + sizeof(Header);
+        if(std::memcmp(header->magic, magic(), sizeof(header->magic)) != 0
+           || header->key_length != key.size()
+           || header->num_values != num_values
+           || std::memcmp(stored_key, key.data(), key.size()) != 0)
+            return nullptr;
+
+        return mapping;
+    }
+
+    /**
+     * Creates a new values file that can be filled through data(). It becomes visible as path after commit().
+     */
+    static std::unique_ptr<MappedValues> create(const std::string& path, const std::string& key, const uint64_t num_values)
+    {
+        std::unique_ptr<MappedValues> mapping(new MappedValues());
+        mapping->path = path;
+        mapping->tmp_path = path + ".tmp." + std::to_string(getpid());
+        mapping->data_offset = get_data_offset(key);
+        mapping->size = mapping->data_offset + num_values * sizeof(argument_type);
+
+        const int fd = open(mapping->tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if(fd < 0)
+            throw std::runtime_error("Could not create the value cache file " + mapping->tmp_path);
+
+        if(ftruncate(fd, static_cast<off_t>(mapping->size)) != 0)
+        {
+            close(fd);
+            throw std::runtime_error("Could not resize the value cache file " + mapping->tmp_path);
+        }
+
+        mapping->base = mmap(nullptr, mapping->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if(mapping->base == MAP_FAILED)
+            throw std::runtime_error("Could not map the value cache file " + mapping->tmp_path);
+
+        Header header = {};
+        std::memcpy(header.magic, magic(), sizeof(header.magic));
+        header.key_length = key.size();
+        header.num_values = num_values;
+        std::memcpy(mapping->base, &header, sizeof(header));
+        std::memcpy(static_cast<char*>(mapping->base) + sizeof(Header), key.data(), key.size());
+
+        return mapping;
+    }
+
+    /**
+     * Makes a newly created file visible under its final name.
+     */
+    void commit()
+    {
+        if(tmp_path.empty())
+            return;
+
+        if(std::rename(tmp_path.c_str(), path.c_str()) != 0)
+            throw std::runtime_error("Could not store the value cache file " + path);
+        tmp_path.clear();
+    }
+
+    argument_type* data()
+    {
+        return reinterpret_cast<argument_type*>(static_cast<char*>(base) + data_offset);
+    }
+
+    const std::string& get_path() const
+    {
+        return path;
+    }
+
+    /**
+     * FNV-1a hash of the key, used to build short file names.
+     */
+    static std::string hash(const std::string& key)
+    {
+        uint64_t h = 14695981039346656037ull;
+        for(const char c : key)
+        {
+            h ^= static_cast<uint8_t>(c);
+            h *= 1099511628211ull;
+        }
+
+        char hex[17];
+        std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(h));
+        return hex;
+    }
+
+private:
+    static const char* magic()
+    {
+        return "GAVALUES";
+    }
+
+    static size_t get_data_offset(const std::string& key)
+    {
+        return (sizeof(Header) + key.size() + 63) / 64 * 64;
+    }
+};
+
+#endif //GENERATIVEART_VALUE_CACHE_H
@@ -0,0 +1,128 @@
+#ifndef GENERATIVEART_VALUE_HISTOGRAM_H
+#define GENERATIVEART_VALUE_HISTOGRAM_H
+
+#include "FunctionPool.h"
+
+#include <omp.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+/**
+ * Fine grained histogram of the values of a random function. Every bin remembers the smallest and the largest value
+ * that fell into it, so a color map can be evaluated on actual values of the image. NaN and infinite values get their
+ * own bins, since the color maps map them to fixed colors.
+ *
+ * The number of bins grows with the number of values, so small images do not pay for bins that stay empty. The bins of
+ * the threads are kept, so one histogram can be computed for one image after another without allocating.
+ */
+class ValueHistogram
+{
+public:
+    struct Bin
+    {
+        uint64_t count = 0;
+        argument_type min = std::numeric_limits<argument_type>::max();
+        argument_type max = std::numeric_limits<argument_type>::lowest();
+    };
+
+    // the number of finite bins is num_values / values_per_bin, within these bounds
+    static constexpr size_t min_bins = 64;
+    static constexpr size_t max_bins = 1u << 16;
+    static constexpr uint64_t values_per_bin = 16;
+
+private:
+    std::vector<Bin> bins;
+    std::vector<std::vector<Bin>> thread_bins;
+
+    // the bins for NaN, -inf and inf are stored behind the finite bins
+    size_t num_finite_bins = 0;
+
+    argument_type min_value = std::numeric_limits<argument_type>::max();
+    argument_type max_value = std::numeric_limits<argument_type>::lowest();
+
+public:
+    ValueHistogram() = default;
+
+    ValueHistogram(const argument_type* values, const uint64_t num_values)
+    {
+        compute(values, num_values);
+    }
+
+    /**
+     * Replaces the histogram by the one of the values.
+     */
+    void compute(const argument_type* values, const uint64_t num_values)
+    {
+        num_finite_bins = static_cast<size_t>(std::min<uint64_t>(max_bins, std::max<uint64_t>(
+            min_bins, num_values / values_per_bin)));
+        bins.assign(num_finite_bins + 3, Bin());
+        thread_bins.resize(static_cast<size_t>(omp_get_max_threads()));
+
+        argument_type min_v = std::numeric_limits<argument_type>::max();
+        argument_type max_v = std::numeric_limits<argument_type>::lowest();
+
+#pragma omp parallel for schedule(static) reduction(min:min_v) reduction(max:max_v)
+        for(uint64_t i = 0; i < num_values; i++)
+        {
+            if(std::isfinite(values[i]))
+            {
+                min_v = std::min(min_v, values[i]);
+                max_v = std::max(max_v, values[i]);
+            }
+        }
+
+        min_value = min_v;
+        max_value = max_v;
+
+        const double scale = max_v > min_v ? num_finite_bins / (static_cast<double>(max_v) - min_v) : 0.0;
+
+#pragma omp parallel
+        {
+            std::vector<Bin>& local = thread_bins[static_cast<size_t>(omp_get_thread_num())];
+            local.assign(bins.size(), Bin());
+
+#pragma omp for schedule(static)
+            for(uint64_t i = 0; i < num_values; i++)
+            {
+                Bin& bin = local[bin_index(values[i], scale)];
+                bin.count++;
+                bin.min = std::min(bin.min, values[i]);
+                bin.max = std::max(bin.max, values[i]);
+            }
+
+#pragma omp critical
+            for(size_t b = 0; b < bins.size(); b++)
+            {
+                bins[b].count += local[b].count;
+                bins[b].min = std::min(bins[b].min, local[b].min);
+                bins[b].max = std::max(bins[b].max, local[b].max);
+            }
+        }
+
+        // std::min and std::max drop NaN, so the NaN bin gets its representative here.
+        bins[num_finite_bins].min = bins[num_finite_bins].max = std::numeric_limits<argument_type>::quiet_NaN();
+    }
+
+    const std::vector<Bin>& get_bins() const
+    {
+        return bins;
+    }
+
+private:
+    size_t bin_index(const argument_type v, const double scale) const
+    {
+        if(std::isnan(v))
+            return num_finite_bins;
+        if(std::isinf(v))
+            return v < 0 ? num_finite_bins + 1 : num_finite_bins + 2;
+
+        const auto b = static_cast<size_t>((static_cast<double>(v) - min_value) * scale);
+        return std::min(b, num_finite_bins - 1);
+    }
+};
+
+#endif //GENERATIVEART_VALUE_HISTOGRAM_H
@@ -0,0 +1,261 @@
+#ifndef GENERATIVEART_WORKER_POOL_H
+#define GENERATIVEART_WORKER_POOL_H
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * Memory that can be shared with other processes by handing over its file descriptor.
+ */
+class SharedMemory
+{
+    int fd = -1;
+    void* base = MAP_FAILED;
+    size_t size = 0;
+
+public:
+    SharedMemory() = default;
+
+    /**
+     * Creates new memory of the given size.
+     */
+    explicit SharedMemory(const size_t size)
+        : fd(memfd_create("GenerativeArt", MFD_CLOEXEC)),
+          size(size)
+    {
+        if(fd < 0 || ftruncate(fd, static_cast<off_t>(size)) != 0)
+            throw std::runtime_error("Could not create shared memory of " + std::to_string(size) + " bytes.");
+        map();
+    }
+
+    SharedMemory(const SharedMemory&) = delete;
+    SharedMemory& operator=(const SharedMemory&) = delete;
+
+    ~SharedMemory()
+    {
+        reset();
+    }
+
+    /**
+     * Maps memory created by another process. Takes the ownership of the file descriptor.
+     */
+    void attach(const int shared_fd, const size_t shared_size)
+    {
+        reset();
+        fd = shared_fd;
+        size = shared_size;
+        map();
+    }
+
+    void reset()
+    {
+        if(base != MAP_FAILED)
+            munmap(base, size);
+        if(fd >= 0)
+            close(fd);
+        base = MAP_FAILED;
+        fd = -1;
+        size = 0;
+    }
+
+    uint8_t* data()
+    {
+        return static_cast<uint8_t*>(base);
+    }
+
+    int get_fd() const
+    {
+        return fd;
+    }
+
+private:
+    void map()
+    {
+        if(size == 0)
+            return;
+
+        base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if(base == MAP_FAILED)
+            throw std::runtime_error("Could not map shared memory of " + std::to_string(size) + " bytes.");
+    }
+};
+
+/**
+ * Worker processes that are connected to the creating process by a socket each. The workers are forked in the
+ * constructor, so the pool must be created before OpenMP starts its threads, since these do not survive a fork.
+ *
+ * Messages are sent as datagrams of a sequenced packet socket, so every receive() gets exactly one send(). A file
+ * descriptor can be passed along with a message.
+ */
+class WorkerPool
+{
+    std::vector<pid_t> pids;
+    std::vector<int> sockets;
+
+public:
+    /**
+     * @param worker_main Runs in every worker with the socket to the creating process. The worker exits when it
+     * returns, it should return once receive() fails.
+     */
+    WorkerPool(const unsigned int num_workers, const std::function<void(int)>& worker_main)
+    {
+        // buffered output would be written by every worker again
+        std::cout.flush();
+        std::cerr.flush();
+
+        for(unsigned int i = 0; i < num_workers; i++)
+        {
+            int pair[2];
+            if(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, pair) != 0)
+                throw std::runtime_error("Could not create the sockets of the workers.");
+
+            const pid_t pid = fork();
+            if(pid < 0)
+                throw std::runtime_error("Could not start the worker processes.");
+
+            if(pid == 0)
+            {
+                for(const int fd : sockets)
+                    close(fd);
+                close(pair[0]);
+
+                int exit_code = 0;
+                try
+                {
+                    worker_main(pair[1]);
+                }
+                catch(const std::exception& e)
+                {
+                    std::cerr << "Worker " << i << " failed: " << e.what() << std::endl;
+                    exit_code = 1;
+                }
+                std::cout.flush();
+                _exit(exit_code);
+            }
+
+            close(pair[1]);
+            pids.push_back(pid);
+            sockets.push_back(pair[0]);
+        }
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    /**
+     * Closes the sockets, which stops the workers, and waits for them.
+     */
+    ~WorkerPool()
+    {
+        for(const int fd : sockets)
+            close(fd);
+        for(const pid_t pid : pids)
+            waitpid(pid, nullptr, 0);
+    }
+
+    size_t size() const
+    {
+        return sockets.size();
+    }
+
+    int socket(const size_t worker) const
+    {
+        return sockets[worker];
+    }
+
+    /**
+     * Blocks until a worker sent a message or closed its socket.
+     * @return The index of the worker.
+     */
+    size_t wait_any() const
+    {
+        std::vector<pollfd> fds(sockets.size());
+        for(size_t i = 0; i < sockets.size(); i++)
+            fds[i] = {sockets[i], POLLIN, 0};
+
+        while(poll(fds.data(), fds.size(), -1) < 0)
+            if(errno != EINTR)
+                throw std::runtime_error("Waiting for the workers failed.");
+
+        for(size_t i = 0; i < fds.size(); i++)
+            if(fds[i].revents != 0)
+                return i;
+
+        throw std::runtime_error("Waiting for the workers failed.");
+    }
+
+    /**
+     * @param passed_fd A file descriptor that is duplicated into the receiving process, -1 for none.
+     */
+    static void send(const int fd, const void* data, const size_t size, const int passed_fd = -1)
+    {
+        iovec iov = {const_cast<void*>(data), size};
+        msghdr message = {};
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+
+        char control[CMSG_SPACE(sizeof(int))] = {};
+        if(passed_fd >= 0)
+        {
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+            cmsghdr* header = CMSG_FIRSTHDR(&message);
+            header->cmsg_level = SOL_SOCKET;
+            header->cmsg_type = SCM_RIGHTS;
+            header->cmsg_len = CMSG_LEN(sizeof(int));
+            std::memcpy(CMSG_DATA(header), &passed_fd, sizeof(int));
+        }
+
+        if(sendmsg(fd, &message, MSG_NOSIGNAL) != static_cast<ssize_t>(size))
+            throw std::runtime_error("Sending a message to another process failed.");
+    }
+
+    /**
+     * @param passed_fd Receives the passed file descriptor, or -1 if there is none.
+     * @return false if the other process closed the socket.
+     */
+    static bool receive(const int fd, void* data, const size_t size, int* passed_fd = nullptr)
+    {
+        iovec iov = {data, size};
+        msghdr message = {};
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+
+        char control[CMSG_SPACE(sizeof(int))] = {};
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        ssize_t received;
+        while((received = recvmsg(fd, &message, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR);
+
+        if(received <= 0)
+            return false;
+        if(received != static_cast<ssize_t>(size))
+            throw std::runtime_error("Received a message of the wrong size from another process.");
+
+        if(passed_fd != nullptr)
+        {
+            *passed_fd = -1;
+            const cmsghdr* header = CMSG_FIRSTHDR(&message);
+            if(header != nullptr && header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS)
+                std::memcpy(passed_fd, CMSG_DATA(header), sizeof(int));
+        }
+
+        return true;
+    }
+};
+
+#endif //GENERATIVEART_WORKER_POOL_H
@@ -415,6 +415,20 @@ namespace png
         }
 #endif
 
+#if defined(PNG_WRITE_SUPPORTED)
+        void set_compression_level(int level) const
+        {
+            TRACE_IO_TRANSFORM("png_set_compression_level: level=%d\n", level);
+            png_set_compression_level(m_png, level);
+        }
+
+        void set_filter(int filters) const
+        {
+            TRACE_IO_TRANSFORM("png_set_filter: filters=%d\n", filters);
+            png_set_filter(m_png, PNG_FILTER_TYPE_BASE, filters);
+        }
+#endif
+
     protected:
         void* get_io_ptr() const
         {
@@ -29,6 +29,23 @@ const std::vector<FunctionPool::unary_function_discription> FunctionPool::unary_
     {"(", ")^3"}
 };
 
+// the same operations as the functions above in C, sqrt is the double version
+const std::vector<std::string> FunctionPool::unary_code = {
+    "sinf(a)",
+    "cosf(a)",
+    "expf(a)",
+    "logf(a)",
+    "sinhf(a)",
+    "coshf(a)",
+    "tanhf(a)",
+    "fabsf(a)",
+    "(float)sqrt((double)a)",
+    "a",
+    "-a",
+    "a*a",
+    "a*a*a"
+};
+
 const std::vector<FunctionPool::binary_function> FunctionPool::binary = {
     [](const argument_type a, const argument_type b){ return a + b; },
     [](const argument_type a, const argument_type b){ return a - b; },
@@ -44,6 +61,13 @@ const std::vector<FunctionPool::binary_function_discription> FunctionPool::binar
     std::make_tuple("sin(", " * ", ")")
 };
 
+// the same operations as the functions above in C, sin is the double version
+const std::vector<std::string> FunctionPool::binary_code = {
+    "a + b",
+    "a - b",
+    "a * b",
+    "(float)sin((double)(a * b))"
+};
 
 
 
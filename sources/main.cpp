@@ -6,6 +6,13 @@
 #include <CLI11Domain.h>
 
 #include "GenerativeArt.h"
+#include "RenderServer.h"
+#include "BatchRegenerator.h"
+
+// a renderer with a baked random function and color map, see add_baked_renderer() in CMakeLists.txt
+#ifdef GENERATIVEART_BAKED_FUNCTION
+#include GENERATIVEART_BAKED_FUNCTION
+#endif
 
 constexpr int wid = 30;
 constexpr int space = ' ';
@@ -60,9 +67,169 @@ int read_settings(GenerativeArt::Settings& settings, int argc, char**& argv)
         ->configurable(true)
         ->group("Program Options");
 
+    app.add_option("--serve", settings.serve_socket,
+                   "Runs a render server on the given unix socket. Clients send one command per line: "
+                   "\"RENDER <file name> <resolution> <output path>\", \"PING\", \"QUIT\" or \"SHUTDOWN\". "
+                   "All options that are not encoded in the file name are taken from the command line.")
+        ->configurable(false)
+        ->group("Program Options");
+    app.add_option("--queue-size", settings.queue_size,
+                   "The number of render jobs the server queues before clients have to wait.", true)
+        ->check(CLI::Range(1u, 1000000u))
+        ->configurable(true)
+        ->group("Program Options");
+    auto* regenerate = app.add_option("--regenerate-dir", settings.regenerate_dir,
+                   "Regenerates every image of the given directory with the current resolution in one run and stores "
+                   "it in the output directory. The settings are read from the file names like with --file-name. "
+                   "The largest images are rendered first and images whose output files exist are skipped.")
+        ->check(CLI::ExistingDirectory)
+        ->configurable(false)
+        ->excludes("--serve")
+        ->group("Program Options");
+
+    // Output Options
+    app.add_option("--png-threads", settings.png_threads,
+                   "Number of threads used to compress the png files. The image rows are split into bands that get "
+                   "deflated in parallel. 1 uses libpng.", true)
+        ->check(CLI::Range(1u, 1024u))
+        ->configurable(true)
+        ->group("Output Options");
+    app.add_option("--png-level", settings.png_level,
+                   "The zlib compression level of the png files. 0 is no compression, 9 is the best compression.", true)
+        ->check(CLI::Range(0u, 9u))
+        ->configurable(true)
+        ->group("Output Options");
+    std::string png_filter = "adaptive";
+    app.add_set("--png-filter", png_filter, {"none", "sub", "up", "paeth", "adaptive"},
+                "The row filter of the png files. Adaptive picks the best filter for every row.", true)
+        ->configurable(true)
+        ->group("Output Options");
+    app.add_option("--memory-budget", settings.memory_budget,
+                   "The memory in MiB the image buffers may use. The peak is estimated before an image is rendered, "
+                   "images that do not fit encode png files by one thread, then evaluate the values in bands of rows "
+                   "and keep only the colors, then render bands of rows that are streamed to the image file. The "
+                   "statistics for rejecting and normalizing images are taken from a preview on a sub grid then. 0 "
+                   "means no limit.", true)
+        ->configurable(true)
+        ->group("Output Options");
+    std::string tiles = "none";
+    app.add_set("--tiles", tiles, {"none", "dzi", "xyz"},
+                "Exports a deep zoom tile pyramid instead of a single image. Every level is rendered directly from the "
+                "random function. dzi writes <name>.dzi and <name>_files/<level>/<column>_<row>.<ext>, "
+                "xyz writes <name>_tiles/<z>/<x>/<y>.<ext>.", true)
+        ->configurable(true)
+        ->excludes("--color-permutations")
+        ->group("Output Options");
+    app.add_option("--tile-size", settings.tile_size, "The edge length of the tiles in pixels.", true)
+        ->check(CLI::Range(1u, 65536u))
+        ->configurable(true)
+        ->group("Output Options");
+    app.add_option("--value-cache", settings.value_cache,
+                   "Directory where the values of the random functions are cached. A later run with the same function "
+                   "seed, function options, domain and resolution maps the values and only applies the color map. "
+                   "Not used for banded rendering and tile export.")
+        ->check(CLI::ExistingDirectory)
+        ->configurable(true)
+        ->group("Output Options");
+    app.add_option("--jit", settings.jit,
+                   "Directory of random functions compiled at run time. Every function is compiled by the C compiler "
+                   "($CC or cc, run by the shell, so it may hold flags) into a shared library that evaluates its "
+                   "rows, a function that was compiled before is loaded from the directory. The pixels are the same "
+                   "as interpreted. Without a compiler, and in the worker processes of --workers, the functions are "
+                   "interpreted. Pays off for large images, small ones spend more time compiling than evaluating.")
+        ->configurable(true)
+        ->group("Output Options");
+    app.add_option("--render-cache", settings.render_cache,
+                   "Directory of an index of rendered images. An image that was rendered before with the same "
+                   "settings, resolution and format is hard linked (or copied) from the cache instead of being "
+                   "rendered again. Not used for tile export and color variants.")
+        ->check(CLI::ExistingDirectory)
+        ->configurable(true)
+        ->group("Output Options");
+    std::string format = "png";
+    app.add_set("--format", format, {"png", "ppm", "pam", "qoi"},
+                "The file format of the images. ppm and pam are uncompressed, qoi is a fast lossless format. "
+                "All three are meant for images that get re-encoded by another tool anyway.", true)
+        ->configurable(true)
+        ->group("Output Options");
+    bool fast_output = false;
+    app.add_flag("--fast-output", fast_output,
+                 "Preset for throwaway images that favors encoding speed over file size. "
+                 "Same as --png-level 1 --png-filter none, unless they are set explicitly.")
+        ->configurable(true)
+        ->group("Output Options");
+
+    app.add_flag("--no-prescreen", [&settings](int count){ settings.prescreen = !count; },
+                 "Stops screening random color maps on a histogram of the function values. The screening rejects "
+                 "single color images without coloring the whole image, but only those the check of the colored "
+                 "image would reject, so the images are the same.")
+        ->configurable(true)
+        ->group("Output Options");
+    app.add_option("--color-variants", settings.color_variants,
+                   "Number of color maps applied to every random function. The function is evaluated only once and "
+                   "every accepted variant is stored in its own file. With a fixed color seed the variants use the "
+                   "following seeds.", true)
+        ->check(CLI::Range(1u, 100000u))
+        ->configurable(true)
+        ->excludes("--tiles", "--memory-budget")
+        ->group("Output Options");
+    app.add_option("--workers", settings.workers,
+                   "Number of worker processes that render the tiles of an image. The colors are gathered in shared "
+                   "memory and the image is encoded once. Every worker uses its share of the OpenMP threads. "
+                   "1 renders in this process.", true)
+        ->check(CLI::Range(1u, 1024u))
+        ->configurable(true)
+        ->excludes("--serve", "--regenerate-dir", "--tiles", "--value-cache", "--color-variants")
+        ->group("Output Options");
+    std::string affinity = "none";
+    app.add_set("--affinity", affinity, {"none", "compact", "spread"},
+                "Pins every OpenMP thread to one cpu. compact fills one socket before the next one, spread alternates "
+                "between the sockets. Pinned threads keep working on the memory they touched first.", true)
+        ->configurable(true)
+        ->excludes("--workers")
+        ->group("Output Options");
+    auto* profile = app.add_option("--profile", settings.profile,
+                   "Writes the time every sample spends drawing, compiling, evaluating, coloring, checking, "
+                   "normalizing and writing to this json file, together with the busy time of every thread, the "
+                   "pixels per second and the rejection rate.")
+        ->configurable(false)
+        ->excludes("--serve", "--regenerate-dir")
+        ->group("Output Options");
+    app.add_flag("--perf-counters", settings.perf_counters,
+                 "Adds the hardware event counts of every stage to the profile, e.g. cycles, instructions, cache and "
+                 "branch misses. Counters the system does not provide are left out.")
+        ->configurable(false)
+        ->needs(profile)
+        ->group("Output Options");
+    app.add_option("--trace", settings.trace,
+                   "Records when every thread worked on which stage of which sample and when every file was written. "
+                   "The events are written to this json file in the Chrome trace format, which opens in Perfetto.")
+        ->configurable(false)
+        ->excludes("--serve", "--regenerate-dir")
+        ->group("Output Options");
+    app.add_flag("--profile-nodes", settings.profile_nodes,
+                 "Prints every random function annotated with the share of the evaluation time and the NaN, infinite "
+                 "and denormal values of every node, measured on a grid of 128x128 pixels, and the same summed up by "
+                 "function of the pool.")
+        ->configurable(false)
+        ->excludes("--serve")
+        ->group("Output Options");
+    app.add_option("--bake", settings.bake,
+                   "Writes the random function and the color map of the seeds, e.g. of --file-name, as straight-line "
+                   "C++ code to this file and exits. A renderer built from it by add_baked_renderer() in "
+                   "CMakeLists.txt renders these seeds faster, with the same pixels.")
+        ->configurable(false)
+        ->excludes("--serve", "--regenerate-dir")
+        ->group("Output Options");
+    app.add_flag("--huge-pages", settings.huge_pages,
+                 "Backs the image buffers by transparent huge pages. The buffers are kept from one image to the next, "
+                 "so this saves page faults on large images.")
+        ->configurable(true)
+        ->group("Output Options");
+
     // Randomness Options
     std::string file_name;
-    auto* f = app.add_option("-f,--file-name", file_name, "The file name of a sample image. "
+    auto* f = app.add_option("-f,--file-name", file_name, "The file name of a sample image (png, ppm, pam or qoi). "
         "This can be used to regenerate the image on a higher resolution. "
         "If used you cannot use any of the randomness options.")
         ->configurable(false)
@@ -109,7 +276,31 @@ int read_settings(GenerativeArt::Settings& settings, int argc, char**& argv)
         ->configurable(true)
         ->excludes(f)
         ->group("Randomness Options");
+    auto* stream = app.add_option("--seed-stream", settings.seed_stream_base,
+               "Derives the seeds from a counter based generator with this base instead of the random device. Sample "
+               "i gets seeds that only depend on the base and i, so every sample can be reproduced from both and "
+               "processes with different shards never draw the same seeds.")
+        ->configurable(true)
+        ->group("Randomness Options");
+    std::string shard = "0/1";
+    app.add_option("--shard", shard,
+               "Uses the samples i, i + n, i + 2n, ... of the seed stream for --shard i/n. Every generated image, "
+               "accepted or rejected, uses one sample.", true)
+        ->check([&settings](const std::string& str){
+            return SeedStream::parse_shard(str, settings.shard, settings.num_shards);
+        })
+        ->needs(stream)
+        ->configurable(true)
+        ->group("Randomness Options");
+    app.add_option("--seed-index", settings.seed_index,
+               "The number of samples of the shard to skip. With --shard 0/1 the first image uses sample i of the "
+               "seed stream for --seed-index i.", true)
+        ->needs(stream)
+        ->configurable(true)
+        ->group("Randomness Options");
     f->excludes(P, D, p, d, F, C, u, b);
+    stream->excludes(f, F, C, regenerate)->excludes("--serve");
+    regenerate->excludes(f, P, D, p, d, F, C, u, b);
 
     // Image Options
     app.add_option("-r,--resolution", settings.resolution,
@@ -152,12 +343,44 @@ int read_settings(GenerativeArt::Settings& settings, int argc, char**& argv)
 
     settings.pt = static_cast<ColorMap::projection_type>(pt_tmp);
 
+    if(fast_output)
+    {
+        if(app.count("--png-level") == 0)
+            settings.png_level = 1;
+        if(app.count("--png-filter") == 0)
+            png_filter = "none";
+    }
+
+    const std::unordered_map<std::string, PngEncoder::filter_type> png_filters = {
+        {"none", PngEncoder::none}, {"sub", PngEncoder::sub}, {"up", PngEncoder::up},
+        {"paeth", PngEncoder::paeth}, {"adaptive", PngEncoder::adaptive}
+    };
+    settings.png_filter = png_filters.at(png_filter);
+
+    settings.affinity = affinity == "compact" ? ThreadAffinity::compact
+                        : (affinity == "spread" ? ThreadAffinity::spread : ThreadAffinity::none);
+
+    settings.tiles = tiles == "dzi" ? GenerativeArt::dzi : (tiles == "xyz" ? GenerativeArt::xyz : GenerativeArt::no_tiles);
+
+    const auto& extensions = ImageWriter::extensions();
+    settings.format = static_cast<ImageWriter::format>(
+        std::find(extensions.begin(), extensions.end(), format) - extensions.begin());
+
+    settings.seed_stream = app.count("--seed-stream") > 0;
+    settings.scale = !no_scale;
+    settings.file_name_pt = app.count("--projection-type") <= 0;
+    settings.file_name_x = app.count("-x") <= 0;
+    settings.file_name_y = app.count("-y") <= 0;
+
     if(app.count("--file-name") > 0)
     {
-        settings.read_file_name(file_name, app.count("--projection-type") <= 0,
-                                app.count("-x") <= 0, app.count("-y") <= 0);
+        settings.read_file_name(file_name, settings.file_name_pt, settings.file_name_x, settings.file_name_y);
     }
 
+    // a baked renderer is made for one image
+    if(!settings.bake.empty() && (settings.random_function_seed == 0 || settings.color_map_seed == 0))
+        exit(app.exit(CLI::ValidationError("--bake", "needs both seeds, e.g. from --file-name")));
+
     // if both seeds are set only one image is generated
     if(settings.random_function_seed != 0 && settings.color_map_seed != 0)
     {
@@ -170,15 +393,9 @@ int read_settings(GenerativeArt::Settings& settings, int argc, char**& argv)
         }
     }
 
-    if(!no_scale)
-    {
-        float min_edge_length = std::fmin(settings.x.max - settings.x.min, settings.y.max - settings.y.min);
-        if(min_edge_length < 1)
-        {
-            settings.resolution = static_cast<unsigned int>(settings.resolution / min_edge_length + 1);
-            verbose(settings.verbose, "Adjusted resolution to " + std::to_string(settings.resolution) + "px");
-        }
-    }
+    // the batch run scales the resolution for every image on its own
+    if(settings.scale && settings.regenerate_dir.empty() && settings.scale_resolution())
+        verbose(settings.verbose, "Adjusted resolution to " + std::to_string(settings.resolution) + "px");
 
     // if the seed is set without a resolution, the resolution will be set to 3840px.
 
@@ -217,7 +434,55 @@ int main(int argc, char** argv)
     if(cli_response != 0)
         return cli_response;
 
+    // --affinity excludes --workers, since the workers must be forked before OpenMP starts its threads
+    if(settings.affinity != ThreadAffinity::none)
+        verbose(settings.verbose, "Pinned threads (thread:cpu): " + ThreadAffinity::pin_threads(settings.affinity));
+
+    if(!settings.serve_socket.empty())
+    {
+        RenderServer server(settings, settings.serve_socket, settings.queue_size);
+        server.run();
+        return 0;
+    }
+
+    if(!settings.regenerate_dir.empty())
+    {
+        BatchRegenerator batch(settings);
+        return batch.run() == 0 ? 0 : 1;
+    }
+
+    if(!settings.bake.empty())
+    {
+        GenerativeArt(settings).bake(settings.bake);
+        return 0;
+    }
+
+    // the workers are forked before OpenMP starts any threads
+    std::unique_ptr<WorkerPool> workers;
+    if(settings.workers > 1)
+        workers.reset(new WorkerPool(settings.workers, [&settings](const int fd){
+            GenerativeArt::serve_tiles(settings, fd);
+        }));
+
     GenerativeArt ga(settings);
+    ga.set_worker_pool(workers.get());
+#ifdef GENERATIVEART_BAKED_FUNCTION
+    ga.set_baked(baked::function_key, baked::eval_row, baked::color_key, baked::color_row);
+#endif
+
+    // the trace is recorded by the scopes of the profiler
+    std::unique_ptr<Tracer> tracer;
+    std::unique_ptr<Profiler> profiler;
+    if(!settings.profile.empty() || !settings.trace.empty())
+    {
+        profiler.reset(new Profiler(settings.perf_counters));
+        ga.set_profiler(profiler.get());
+    }
+    if(!settings.trace.empty())
+    {
+        tracer.reset(new Tracer());
+        profiler->set_tracer(tracer.get());
+    }
 
     unsigned int num_empty_images = 0;
 
@@ -240,5 +505,10 @@ int main(int argc, char** argv)
         }
     }
 
+    if(!settings.profile.empty())
+        profiler->write_json(settings.profile);
+    if(tracer)
+        tracer->write_json(settings.trace);
+
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,132 @@
+// Renders the same images of a seed stream with and without the prescreening. The prescreening may only reject color
+// maps the check of the colored image rejects too, so both runs must accept the same images and write the same files.
+// The seed stream 7 contains an image at -r 40 that an earlier prescreening rejected, the index 262.
+
+#include "GenerativeArt.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+std::string read_file(const std::string& file_name)
+{
+    std::ifstream in(file_name, std::ios::binary);
+    std::ostringstream content;
+    content << in.rdbuf();
+    return content.str();
+}
+
+/**
+ * Renders the first num_images images of the seed stream into the directory.
+ * @return Whether every image got accepted.
+ */
+std::vector<bool> render(const std::string& directory, const uint64_t stream, const unsigned int num_images,
+                         const unsigned int resolution, const ColorMap::projection_type pt, const bool prescreen,
+                         const unsigned int color_variants)
+{
+    GenerativeArt::Settings settings;
+    settings.seed_stream = true;
+    settings.seed_stream_base = stream;
+    settings.resolution = resolution;
+    settings.pt = pt;
+    settings.num_samples = 1;
+    settings.format = ImageWriter::ppm;
+    settings.directory = directory;
+    settings.prescreen = prescreen;
+    settings.color_variants = color_variants;
+
+    GenerativeArt ga(settings);
+    std::vector<bool> accepted;
+    for(unsigned int i = 0; i < num_images; i++)
+        accepted.push_back(ga.generate());
+    return accepted;
+}
+
+int main()
+{
+    char directory_template[] = "/tmp/prescreen_outputs.XXXXXX";
+    if(!mkdtemp(directory_template))
+    {
+        std::cout << "FAILED, no temporary directory" << std::endl;
+        return 1;
+    }
+    const std::string directory = std::string(directory_template) + "/";
+
+    struct Case
+    {
+        uint64_t stream;
+        unsigned int num_images;
+        unsigned int resolution;
+        ColorMap::projection_type pt;
+        unsigned int color_variants;
+    };
+    const std::vector<Case> cases = {{7, 300, 40, ColorMap::cap, 1}, {11, 200, 64, ColorMap::cap, 1},
+                                     {5, 200, 40, ColorMap::periodic, 1}, {5, 200, 40, ColorMap::smooth_periodic, 1},
+                                     {3, 60, 40, ColorMap::cap, 4}};
+
+    bool failed = false;
+    for(const Case& c : cases)
+    {
+        const std::string name = "stream " + std::to_string(c.stream) + ", -r " + std::to_string(c.resolution)
+                                 + ", projection " + std::to_string(c.pt) + ", " + std::to_string(c.color_variants)
+                                 + " color variants";
+        const std::string with = directory + "with/";
+        const std::string without = directory + "without/";
+        std::system(("rm -rf '" + with + "' '" + without + "' && mkdir '" + with + "' '" + without + "'").c_str());
+
+        const auto accepted_with = render(with, c.stream, c.num_images, c.resolution, c.pt, true,
+                                          c.color_variants);
+        const auto accepted_without = render(without, c.stream, c.num_images, c.resolution, c.pt, false,
+                                             c.color_variants);
+
+        unsigned int num_accepted = 0;
+        for(unsigned int i = 0; i < c.num_images; i++)
+        {
+            num_accepted += accepted_without[i];
+            if(accepted_with[i] != accepted_without[i])
+            {
+                std::cout << "FAIL " << name << ": the image " << i << " is "
+                          << (accepted_with[i] ? "accepted" : "rejected") << " with the prescreening and "
+                          << (accepted_without[i] ? "accepted" : "rejected") << " without" << std::endl;
+                failed = true;
+            }
+        }
+
+        // the same files with the same content
+        const std::string list = directory + "files";
+        std::system(("cd '" + without + "' && ls > '" + list + "'").c_str());
+        std::istringstream files(read_file(list));
+        unsigned int num_files = 0;
+        for(std::string file; std::getline(files, file); num_files++)
+        {
+            if(read_file(with + file) != read_file(without + file))
+            {
+                std::cout << "FAIL " << name << ": " << file << " differs or is missing with the prescreening"
+                          << std::endl;
+                failed = true;
+            }
+        }
+        std::system(("cd '" + with + "' && ls > '" + list + "'").c_str());
+        std::istringstream files_with(read_file(list));
+        unsigned int num_files_with = 0;
+        for(std::string file; std::getline(files_with, file);)
+            num_files_with++;
+        if(num_files_with != num_files)
+        {
+            std::cout << "FAIL " << name << ": " << num_files_with << " files with the prescreening, " << num_files
+                      << " without" << std::endl;
+            failed = true;
+        }
+
+        std::cout << name << ": " << num_accepted << " of " << c.num_images << " images accepted, " << num_files
+                  << " files" << std::endl;
+    }
+
+    std::system(("rm -rf '" + directory + "'").c_str());
+
+    std::cout << (failed ? "FAILED" : "PASSED") << std::endl;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,242 @@
+// Writes images with QoiStream and decodes them with a decoder that follows the reference decoder qoi_decode() of
+// qoi.h (https://github.com/phoboslab/qoi) step by step, including its index, which starts with (0, 0, 0, 0), and the
+// alpha channel. Every pixel must come back with its color and alpha 255.
+
+#include "ImageWriter.h"
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+struct Decoded
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<std::array<uint8_t, 4>> pixels;
+};
+
+Decoded decode_qoi(const std::string& file_name)
+{
+    std::ifstream in(file_name, std::ios::binary);
+    const std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    const auto byte = [&](const size_t i)
+    {
+        return static_cast<uint8_t>(bytes.at(i));
+    };
+    const auto read32 = [&](const size_t i)
+    {
+        return static_cast<uint32_t>(byte(i)) << 24 | static_cast<uint32_t>(byte(i + 1)) << 16
+               | static_cast<uint32_t>(byte(i + 2)) << 8 | byte(i + 3);
+    };
+
+    if(bytes.size() < 14 + 8 || bytes.compare(0, 4, "qoif") != 0)
+        throw std::runtime_error("no qoi file");
+    const std::string end_marker("\0\0\0\0\0\0\0\1", 8);
+    if(bytes.compare(bytes.size() - 8, 8, end_marker) != 0)
+        throw std::runtime_error("the end marker is missing");
+
+    Decoded image;
+    image.width = read32(4);
+    image.height = read32(8);
+    if(byte(12) != 3 || byte(13) > 1)
+        throw std::runtime_error("wrong channels or color space");
+
+    std::array<std::array<uint8_t, 4>, 64> index = {};
+    std::array<uint8_t, 4> px = {{0, 0, 0, 255}};
+    unsigned int run = 0;
+    size_t p = 14;
+    const size_t chunks_end = bytes.size() - 8;
+
+    const uint64_t num_pixels = static_cast<uint64_t>(image.width) * image.height;
+    for(uint64_t i = 0; i < num_pixels; i++)
+    {
+        if(run > 0)
+        {
+            run--;
+        }
+        else if(p < chunks_end)
+        {
+            const uint8_t b1 = byte(p++);
+            if(b1 == 0xfe)
+            {
+                px[0] = byte(p++);
+                px[1] = byte(p++);
+                px[2] = byte(p++);
+            }
+            else if(b1 == 0xff)
+            {
+                px[0] = byte(p++);
+                px[1] = byte(p++);
+                px[2] = byte(p++);
+                px[3] = byte(p++);
+            }
+            else if((b1 & 0xc0) == 0x00)
+            {
+                px = index[b1];
+            }
+            else if((b1 & 0xc0) == 0x40)
+            {
+                px[0] = static_cast<uint8_t>(px[0] + ((b1 >> 4) & 0x03) - 2);
+                px[1] = static_cast<uint8_t>(px[1] + ((b1 >> 2) & 0x03) - 2);
+                px[2] = static_cast<uint8_t>(px[2] + (b1 & 0x03) - 2);
+            }
+            else if((b1 & 0xc0) == 0x80)
+            {
+                const uint8_t b2 = byte(p++);
+                const int vg = (b1 & 0x3f) - 32;
+                px[0] = static_cast<uint8_t>(px[0] + vg - 8 + ((b2 >> 4) & 0x0f));
+                px[1] = static_cast<uint8_t>(px[1] + vg);
+                px[2] = static_cast<uint8_t>(px[2] + vg - 8 + (b2 & 0x0f));
+            }
+            else
+            {
+                run = b1 & 0x3f;
+            }
+
+            index[(px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64] = px;
+        }
+
+        image.pixels.push_back(px);
+    }
+
+    if(p != chunks_end)
+        throw std::runtime_error("the chunks do not end with the last pixel");
+
+    return image;
+}
+
+/**
+ * Writes the rgb values in bands of band_rows rows and compares the decoded image to them.
+ * @return Empty if the image comes back, else what differs.
+ */
+std::string round_trip(const std::vector<uint8_t>& rgb, const uint32_t width, const uint32_t height,
+                       const std::array<uint8_t, 3>& channel_order, const uint32_t band_rows)
+{
+    const std::string file_name = "qoi_round_trip.qoi";
+    {
+        QoiStream stream(file_name, width, height, channel_order);
+        for(uint32_t row = 0; row < height; row += band_rows)
+            stream.write_rows(rgb.data() + 3 * static_cast<size_t>(width) * row, std::min(band_rows, height - row));
+        stream.finish();
+    }
+
+    const Decoded image = decode_qoi(file_name);
+    std::remove(file_name.c_str());
+    if(image.width != width || image.height != height)
+        return "the size differs";
+
+    for(size_t i = 0; i < image.pixels.size(); i++)
+    {
+        const auto& px = image.pixels[i];
+        for(size_t c = 0; c < 3; c++)
+            if(px[c] != rgb[3 * i + channel_order[c]])
+            {
+                std::ostringstream out;
+                out << "pixel " << i << " is " << +px[0] << " " << +px[1] << " " << +px[2] << " " << +px[3];
+                return out.str();
+            }
+        if(px[3] != 255)
+            return "pixel " + std::to_string(i) + " has alpha " + std::to_string(px[3]);
+    }
+    return "";
+}
+
+int main()
+{
+    std::default_random_engine prng(2024);
+    std::uniform_int_distribution<int> byte_dist(0, 255);
+    std::uniform_int_distribution<int> step_dist(-40, 40);
+    const auto clamp = [](const int v)
+    {
+        return static_cast<uint8_t>(std::max(0, std::min(255, v)));
+    };
+
+    struct Case
+    {
+        std::string name;
+        uint32_t width;
+        uint32_t height;
+        std::vector<uint8_t> rgb;
+    };
+    std::vector<Case> cases;
+
+    // black hashes to the slot 53 of the index, which the decoder starts with (0, 0, 0, 0)
+    cases.push_back({"black", 50, 3, std::vector<uint8_t>(3 * 150, 0)});
+    {
+        Case c{"black between colors", 64, 4, {}};
+        for(uint32_t i = 0; i < c.width * c.height; i++)
+        {
+            const bool black = i % 3 == 1;
+            c.rgb.push_back(black ? 0 : 200);
+            c.rgb.push_back(black ? 0 : 10);
+            c.rgb.push_back(black ? 0 : static_cast<uint8_t>(i));
+        }
+        cases.push_back(c);
+    }
+    {
+        // few colors, the index gets used
+        Case c{"palette", 97, 31, {}};
+        std::vector<uint8_t> palette(3 * 8);
+        for(auto& v : palette)
+            v = static_cast<uint8_t>(byte_dist(prng));
+        palette[0] = palette[1] = palette[2] = 0;
+        for(uint32_t i = 0; i < c.width * c.height; i++)
+        {
+            const int k = byte_dist(prng) % 8;
+            c.rgb.insert(c.rgb.end(), palette.begin() + 3 * k, palette.begin() + 3 * k + 3);
+        }
+        cases.push_back(c);
+    }
+    {
+        // small and medium steps, diff and luma
+        Case c{"gradient", 128, 40, {}};
+        int r = 128, g = 128, b = 128;
+        for(uint32_t i = 0; i < c.width * c.height; i++)
+        {
+            const int step = i % 5 == 0 ? step_dist(prng) : step_dist(prng) / 20;
+            r = clamp(r + step);
+            g = clamp(g + step / 2);
+            b = clamp(b - step);
+            c.rgb.push_back(static_cast<uint8_t>(r));
+            c.rgb.push_back(static_cast<uint8_t>(g));
+            c.rgb.push_back(static_cast<uint8_t>(b));
+        }
+        cases.push_back(c);
+    }
+    {
+        // noise, and runs longer than 62 pixels across the bands
+        Case c{"noise and runs", 100, 20, {}};
+        for(uint32_t i = 0; i < c.width * c.height; i++)
+        {
+            const bool in_run = (i / 150) % 2 == 1;
+            for(int k = 0; k < 3; k++)
+                c.rgb.push_back(in_run ? 77 : static_cast<uint8_t>(byte_dist(prng)));
+        }
+        cases.push_back(c);
+    }
+
+    const std::array<std::array<uint8_t, 3>, 2> orders = {{{{0, 1, 2}}, {{2, 0, 1}}}};
+    bool failed = false;
+    for(const Case& c : cases)
+        for(const auto& order : orders)
+            for(const uint32_t band_rows : {1u, 7u, c.height})
+            {
+                const std::string difference = round_trip(c.rgb, c.width, c.height, order, band_rows);
+                if(!difference.empty())
+                {
+                    std::cout << "FAIL " << c.name << ", channels " << +order[0] << +order[1] << +order[2]
+                              << ", bands of " << band_rows << " rows: " << difference << std::endl;
+                    failed = true;
+                }
+            }
+
+    std::cout << (failed ? "FAILED" : "PASSED") << std::endl;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,110 @@
+// Renders two resolutions to the same file name with a render cache, like -r 100 and then -r 150 with the same output
+// name, and restores the first one. The cache links its objects to the outputs, so the second image must not be written
+// into the file of the first one.
+
+#include "ImageWriter.h"
+#include "RenderCache.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Writes a ppm image of the size with every byte set to value.
+ */
+void write_image(const std::string& file_name, const uint32_t width, const uint32_t height, const uint8_t value)
+{
+    const std::vector<uint8_t> rgb(3 * static_cast<size_t>(width) * height, value);
+    PngEncoder::Options png_options;
+    auto stream = ImageWriter::open(ImageWriter::ppm, file_name, width, height, png_options, {{0, 1, 2}});
+    stream->write_rows(rgb.data(), height);
+    stream->finish();
+}
+
+/**
+ * The header of a ppm file, e.g. "P6\n100 100\n255\n".
+ */
+std::string read_header(const std::string& file_name)
+{
+    std::ifstream in(file_name, std::ios::binary);
+    std::string magic, size, max_value;
+    std::getline(in, magic);
+    std::getline(in, size);
+    std::getline(in, max_value);
+    return magic + " " + size + " " + max_value;
+}
+
+int main()
+{
+    char directory_template[] = "/tmp/render_cache_resolutions.XXXXXX";
+    if(!mkdtemp(directory_template))
+    {
+        std::cout << "FAILED, no temporary directory" << std::endl;
+        return 1;
+    }
+    const std::string directory = directory_template;
+    const std::string output = directory + "/image.ppm";
+    mkdir((directory + "/cache").c_str(), 0755);
+    const RenderCache cache(directory + "/cache");
+
+    const std::string small_key = "r=100";
+    const std::string large_key = "r=150";
+    const std::string small_header = "P6 100 100 255";
+    const std::string large_header = "P6 150 150 255";
+    bool failed = false;
+    const auto check = [&](const std::string& step, const std::string& expected)
+    {
+        const std::string header = read_header(output);
+        if(header != expected)
+        {
+            std::cout << "FAIL " << step << ": " << header << " instead of " << expected << std::endl;
+            failed = true;
+        }
+    };
+
+    write_image(output, 100, 100, 10);
+    cache.store(small_key, {output});
+    check("-r 100", small_header);
+
+    if(cache.restore(large_key, {output}))
+    {
+        std::cout << "FAIL -r 150 is in the cache before it got rendered" << std::endl;
+        failed = true;
+    }
+    write_image(output, 150, 150, 20);
+    cache.store(large_key, {output});
+    check("-r 150", large_header);
+
+    if(!cache.restore(small_key, {output}))
+    {
+        std::cout << "FAIL -r 100 is not in the cache" << std::endl;
+        failed = true;
+    }
+    check("-r 100 from the cache", small_header);
+
+    if(!cache.restore(large_key, {output}))
+    {
+        std::cout << "FAIL -r 150 is not in the cache" << std::endl;
+        failed = true;
+    }
+    check("-r 150 from the cache", large_header);
+
+    // a temporary file that is left over means an unfinished or failed write
+    std::ifstream temporary(output + ".tmp." + std::to_string(getpid()));
+    if(temporary.is_open())
+    {
+        std::cout << "FAIL the temporary file is left over" << std::endl;
+        failed = true;
+    }
+
+    std::system(("rm -rf '" + directory + "'").c_str());
+
+    std::cout << (failed ? "FAILED" : "PASSED") << std::endl;
+    return failed ? 1 : 0;
+}